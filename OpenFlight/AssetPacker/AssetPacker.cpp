@@ -0,0 +1,268 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetPacker.cpp
+*
+* Packs loose asset files into a single .ofpk archive that FileManager::mountArchive can serve from one mapping
+* Usage: AssetPacker [-c none|lz4|zstd] <output archive> <file or directory>...
+*   Directories are added recursively, entry names are relative to the directory that was passed in.
+*   Compressed entries are only kept compressed when that saves at least an eighth of their size.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<lz4.h>)
+#define OPENFLIGHT_LZ4 1
+#include <lz4.h>
+#endif
+#if __has_include(<zstd.h>)
+#define OPENFLIGHT_ZSTD 1
+#include <zstd.h>
+#endif
+#endif
+
+#include "AssetArchiveFormat.h"
+
+struct PackInput
+{
+	std::string path;
+	std::string name;
+};
+
+static bool readFile(const std::string& path, std::vector<char>& data)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	data.clear();
+	char buffer[64 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + count);
+
+	fclose(file);
+
+	return true;
+}
+
+static bool compress(archiveCompression compression, const std::vector<char>& data, std::vector<char>& out)
+{
+	switch (compression)
+	{
+	case ARCHIVE_COMPRESSION_LZ4:
+#ifdef OPENFLIGHT_LZ4
+	{
+		out.resize((size_t)LZ4_compressBound((int)data.size()));
+		int size = LZ4_compress_default(data.data(), out.data(), (int)data.size(), (int)out.size());
+		if (size <= 0)
+			return false;
+
+		out.resize((size_t)size);
+		return true;
+	}
+#else
+		return false;
+#endif
+	case ARCHIVE_COMPRESSION_ZSTD:
+#ifdef OPENFLIGHT_ZSTD
+	{
+		out.resize(ZSTD_compressBound(data.size()));
+		size_t size = ZSTD_compress(out.data(), out.size(), data.data(), data.size(), 19);
+		if (ZSTD_isError(size))
+			return false;
+
+		out.resize(size);
+		return true;
+	}
+#else
+		return false;
+#endif
+	default:
+		break;
+	}
+
+	(void)data;
+	(void)out;
+	return false;
+}
+
+static void addInput(const char* argument, std::vector<PackInput>& inputs)
+{
+	std::filesystem::path root(argument);
+	std::error_code error;
+
+	if (std::filesystem::is_directory(root, error))
+	{
+		for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(root, error))
+		{
+			if (!entry.is_regular_file(error))
+				continue;
+
+			PackInput input;
+			input.path = entry.path().string();
+			input.name = entry.path().lexically_relative(root).generic_string();
+			inputs.push_back(input);
+		}
+	}
+	else
+	{
+		PackInput input;
+		input.path = root.string();
+		input.name = root.filename().generic_string();
+		inputs.push_back(input);
+	}
+}
+
+static void padTo(FILE* out, uint64_t& position, uint64_t alignment)
+{
+	static const char zeros[ARCHIVE_ALIGNMENT] = {};
+
+	uint64_t padding = (alignment - position % alignment) % alignment;
+	fwrite(zeros, 1, (size_t)padding, out);
+	position += padding;
+}
+
+int main(int argc, char** argv)
+{
+	archiveCompression compression = ARCHIVE_COMPRESSION_NONE;
+	const char* outputName = nullptr;
+	std::vector<PackInput> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "lz4") == 0)
+				compression = ARCHIVE_COMPRESSION_LZ4;
+			else if (strcmp(argv[i], "zstd") == 0)
+				compression = ARCHIVE_COMPRESSION_ZSTD;
+			else
+				compression = ARCHIVE_COMPRESSION_NONE;
+		}
+		else if (!outputName)
+		{
+			outputName = argv[i];
+		}
+		else
+		{
+			addInput(argv[i], inputs);
+		}
+	}
+
+	if (!outputName || inputs.empty())
+	{
+		fprintf(stderr, "Usage: AssetPacker [-c none|lz4|zstd] <output archive> <file or directory>...\n");
+		return -1;
+	}
+
+	std::vector<char> probe;
+	if (compression != ARCHIVE_COMPRESSION_NONE && !compress(compression, std::vector<char>(1, 0), probe))
+	{
+		fprintf(stderr, "This build of AssetPacker does not support the requested compression, storing files uncompressed\n");
+		compression = ARCHIVE_COMPRESSION_NONE;
+	}
+
+	FILE* out = fopen(outputName, "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Failed to create %s\n", outputName);
+		return -1;
+	}
+
+	// The header is written again at the end once the offsets are known
+	ArchiveHeader header = {};
+	memcpy(header.magic, ARCHIVE_MAGIC, 4);
+	header.version = ARCHIVE_VERSION;
+	fwrite(&header, sizeof(header), 1, out);
+
+	uint64_t position = sizeof(header);
+	std::vector<ArchiveEntry> entries;
+	std::string names;
+	std::vector<char> data;
+	std::vector<char> packed;
+	uint64_t totalSize = 0;
+	uint64_t totalStored = 0;
+
+	for (const PackInput& input : inputs)
+	{
+		if (!readFile(input.path, data))
+		{
+			fprintf(stderr, "Failed to read %s, skipping it\n", input.path.c_str());
+			continue;
+		}
+
+		ArchiveEntry entry = {};
+		std::string name = input.name;
+		for (char& c : name)
+			c = normalizeArchiveChar(c);
+
+		entry.hash = hashArchiveName(name.c_str(), name.size());
+		entry.size = data.size();
+		entry.nameOffset = (uint32_t)names.size();
+		entry.nameLength = (uint32_t)name.size();
+		entry.compression = ARCHIVE_COMPRESSION_NONE;
+		names += name;
+
+		const std::vector<char>* stored = &data;
+		if (compression != ARCHIVE_COMPRESSION_NONE && compress(compression, data, packed) && packed.size() < data.size() - data.size() / 8)
+		{
+			stored = &packed;
+			entry.compression = compression;
+		}
+
+		// Every entry starts on a page so views into the mapping are page aligned
+		padTo(out, position, ARCHIVE_ALIGNMENT);
+		entry.offset = position;
+		entry.storedSize = stored->size();
+
+		fwrite(stored->data(), 1, stored->size(), out);
+		position += stored->size();
+
+		totalSize += entry.size;
+		totalStored += entry.storedSize;
+		entries.push_back(entry);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const ArchiveEntry& a, const ArchiveEntry& b) {
+		return a.hash < b.hash;
+	});
+
+	for (size_t i = 1; i < entries.size(); i++)
+	{
+		const ArchiveEntry& a = entries[i - 1];
+		const ArchiveEntry& b = entries[i];
+
+		if (a.hash == b.hash && a.nameLength == b.nameLength && names.compare(a.nameOffset, a.nameLength, names, b.nameOffset, b.nameLength) == 0)
+		{
+			fprintf(stderr, "Duplicate entry %s\n", names.substr(a.nameOffset, a.nameLength).c_str());
+			fclose(out);
+			return -1;
+		}
+	}
+
+	padTo(out, position, alignof(ArchiveEntry));
+	header.entryCount = (uint32_t)entries.size();
+	header.directoryOffset = position;
+	fwrite(entries.data(), sizeof(ArchiveEntry), entries.size(), out);
+	position += entries.size() * sizeof(ArchiveEntry);
+
+	header.namesOffset = position;
+	header.namesSize = names.size();
+	fwrite(names.data(), 1, names.size(), out);
+
+	fseek(out, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, out);
+	fclose(out);
+
+	printf("Packed %u files, %llu bytes stored as %llu\n", header.entryCount, (unsigned long long)totalSize, (unsigned long long)totalStored);
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogDecoder.cpp
+*
+* Expands a binary log written with LoggerSettings::binaryFile back into the usual text lines
+* Usage: LogDecoder [-t] [-s] <input log> [output file]
+*   -t  prefix every line with the time in seconds since logging started
+*   -s  prefix every line with the file and line of the call site
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "LogFormat.h"
+
+struct DecodedSite
+{
+	int lvl;
+	uint64_t line;
+	std::string file;
+	std::string fmt;
+	std::vector<uint8_t> argTypes;
+};
+
+static bool readFile(const char* fileName, std::vector<char>& data)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+
+	char buffer[64 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + count);
+
+	fclose(file);
+
+	return true;
+}
+
+static bool readString(const char*& data, const char* end, std::string& str)
+{
+	uint64_t length;
+	if (!readLogVarint(data, end, length) || (uint64_t)(end - data) < length)
+		return false;
+
+	str.assign(data, (size_t)length);
+	data += length;
+
+	return true;
+}
+
+static void printLine(FILE* out, int lvl, const char* text, size_t length, double seconds, const DecodedSite* site, bool showTime, bool showSite)
+{
+	if (showTime)
+		fprintf(out, "%12.6f ", seconds);
+
+	if (showSite)
+	{
+		if (site)
+			fprintf(out, "%s(%llu) ", site->file.c_str(), (unsigned long long)site->line);
+		else
+			fputs("- ", out);
+	}
+
+	fputs(lvl >= 0 && lvl < 4 ? logLevelMsg[lvl] : "[?]: ", out);
+	fwrite(text, 1, length, out);
+	fputc('\n', out);
+}
+
+int main(int argc, char** argv)
+{
+	bool showTime = false;
+	bool showSite = false;
+	const char* inputName = nullptr;
+	const char* outputName = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0)
+			showTime = true;
+		else if (strcmp(argv[i], "-s") == 0)
+			showSite = true;
+		else if (!inputName)
+			inputName = argv[i];
+		else
+			outputName = argv[i];
+	}
+
+	if (!inputName)
+	{
+		fprintf(stderr, "Usage: LogDecoder [-t] [-s] <input log> [output file]\n");
+		return -1;
+	}
+
+	std::vector<char> data;
+	if (!readFile(inputName, data))
+	{
+		fprintf(stderr, "Failed to open %s\n", inputName);
+		return -1;
+	}
+
+	uint32_t version = 0;
+	uint64_t ticksPerSecond = 0;
+	if (data.size() < LOG_BINARY_HEADER_SIZE || memcmp(data.data(), LOG_BINARY_MAGIC, 4) != 0)
+	{
+		fprintf(stderr, "%s is not a binary OpenFlight log\n", inputName);
+		return -1;
+	}
+
+	memcpy(&version, data.data() + 4, 4);
+	memcpy(&ticksPerSecond, data.data() + 8, 8);
+	if (version != LOG_BINARY_VERSION)
+	{
+		fprintf(stderr, "Unsupported log version %u\n", version);
+		return -1;
+	}
+
+	FILE* out = stdout;
+	if (outputName)
+	{
+		out = fopen(outputName, "w");
+		if (!out)
+		{
+			fprintf(stderr, "Failed to create %s\n", outputName);
+			return -1;
+		}
+	}
+
+	std::vector<DecodedSite> sites;
+	int64_t timestamp = 0;
+	const char* cursor = data.data() + LOG_BINARY_HEADER_SIZE;
+	const char* end = data.data() + data.size();
+	bool truncated = false;
+
+	while (cursor < end && !truncated)
+	{
+		const char* chunkStart = cursor;
+		uint64_t tag;
+		uint64_t value;
+
+		if (!readLogVarint(cursor, end, tag))
+		{
+			cursor = chunkStart;
+			truncated = true;
+			break;
+		}
+
+		// The site id, or the level of a text chunk
+		uint64_t siteId = tag >> LOG_CHUNK_TAG_BITS;
+
+		switch (tag & ((1 << LOG_CHUNK_TAG_BITS) - 1))
+		{
+		case LOG_CHUNK_SITE:
+		{
+			DecodedSite site;
+
+			if (cursor >= end)
+			{
+				truncated = true;
+				break;
+			}
+
+			site.lvl = (uint8_t)*cursor++;
+			if (!readLogVarint(cursor, end, site.line) || !readString(cursor, end, site.file) || !readString(cursor, end, site.fmt) ||
+				cursor >= end || (uint8_t)*cursor > LOG_MAX_ARGS || end - cursor - 1 < (uint8_t)*cursor)
+			{
+				truncated = true;
+				break;
+			}
+
+			size_t argCount = (uint8_t)*cursor++;
+			site.argTypes.assign(cursor, cursor + argCount);
+			cursor += argCount;
+
+			if (sites.size() <= siteId)
+				sites.resize((size_t)siteId + 1);
+			sites[(size_t)siteId] = site;
+			break;
+		}
+		case LOG_CHUNK_EVENT:
+		{
+			uint64_t argBytes;
+
+			if (!readLogVarint(cursor, end, value) || !readLogVarint(cursor, end, argBytes) ||
+				(uint64_t)(end - cursor) < argBytes || siteId >= sites.size())
+			{
+				truncated = true;
+				break;
+			}
+
+			timestamp += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+
+			const DecodedSite& site = sites[(size_t)siteId];
+			LogArg args[LOG_MAX_ARGS];
+			char text[4096];
+
+			size_t argCount = unpackLogArgs(cursor, (size_t)argBytes, site.argTypes.data(), site.argTypes.size(), args);
+			size_t length = formatLogMessage(text, sizeof(text), site.fmt.c_str(), args, argCount);
+			cursor += argBytes;
+
+			printLine(out, site.lvl, text, length, (double)timestamp / ticksPerSecond, &site, showTime, showSite);
+			break;
+		}
+		case LOG_CHUNK_TEXT:
+		{
+			uint64_t length;
+			int lvl = (int)siteId;
+
+			if (!readLogVarint(cursor, end, value) || !readLogVarint(cursor, end, length) || (uint64_t)(end - cursor) < length)
+			{
+				truncated = true;
+				break;
+			}
+
+			timestamp += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+
+			printLine(out, lvl, cursor, (size_t)length, (double)timestamp / ticksPerSecond, nullptr, showTime, showSite);
+			cursor += length;
+			break;
+		}
+		default:
+			truncated = true;
+			break;
+		}
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	// A log from a crashed run can end mid chunk, everything before that point is still printed
+	if (truncated)
+	{
+		fprintf(stderr, "Warning: %s is truncated or corrupt after byte %lld\n", inputName, (long long)(cursor - data.data()));
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetArchive.cpp
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__has_include)
+#if __has_include(<lz4.h>)
+#define OPENFLIGHT_LZ4 1
+#include <lz4.h>
+#endif
+#if __has_include(<zstd.h>)
+#define OPENFLIGHT_ZSTD 1
+#include <zstd.h>
+#endif
+#endif
+
+#include "AssetArchive.h"
+
+bool AssetArchive::open(FileView&& archiveView, const char* archiveName, Logger* primaryLogger)
+{
+	logger = primaryLogger;
+	archive = std::move(archiveView);
+
+	const char* base = archive.getData();
+	uint64_t size = archive.getSize();
+
+	ArchiveHeader header;
+	if (size < sizeof(header))
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_ERR, "Asset archive {} is too small", archiveName);
+		return false;
+	}
+
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, ARCHIVE_MAGIC, 4) != 0 || header.version != ARCHIVE_VERSION)
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_ERR, "{} is not a version {} asset archive", archiveName, ARCHIVE_VERSION);
+		return false;
+	}
+
+	// Everything the entries point at has to be inside the file, after this no lookup needs to check bounds again
+	uint64_t directorySize = (uint64_t)header.entryCount * sizeof(ArchiveEntry);
+	if (header.directoryOffset > size || directorySize > size - header.directoryOffset ||
+		header.namesOffset > size || header.namesSize > size - header.namesOffset ||
+		header.directoryOffset % alignof(ArchiveEntry) != 0)
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_ERR, "Asset archive {} has a corrupt directory", archiveName);
+		return false;
+	}
+
+	const ArchiveEntry* directory = (const ArchiveEntry*)(base + header.directoryOffset);
+	for (uint32_t i = 0; i < header.entryCount; i++)
+	{
+		const ArchiveEntry& entry = directory[i];
+
+		// Uncompressed entries are borrowed as size bytes straight from the mapping, so that is all they may claim
+		if (entry.offset > size || entry.storedSize > size - entry.offset ||
+			(entry.compression == ARCHIVE_COMPRESSION_NONE && entry.size != entry.storedSize) ||
+			(uint64_t)entry.nameOffset + entry.nameLength > header.namesSize ||
+			(i > 0 && directory[i - 1].hash > entry.hash))
+		{
+			if (logger)
+				OF_LOG(*logger, LOG_LVL_ERR, "Asset archive {} has a corrupt entry {}", archiveName, i);
+			return false;
+		}
+	}
+
+	entries = directory;
+	names = base + header.namesOffset;
+	entryCount = header.entryCount;
+
+	if (logger)
+		OF_LOG(*logger, LOG_LVL_INFO, "Mounted asset archive {} ({} files)", archiveName, entryCount);
+
+	return true;
+}
+
+bool AssetArchive::find(const char* name, uint64_t hash, FileView& view) const
+{
+	const ArchiveEntry* end = entries + entryCount;
+	const ArchiveEntry* entry = std::lower_bound(entries, end, hash, [](const ArchiveEntry& a, uint64_t h) {
+		return a.hash < h;
+	});
+
+	size_t nameLength = strlen(name);
+
+	// Names are stored normalized, compare them as well in case two names share a hash
+	for (; entry != end && entry->hash == hash; entry++)
+	{
+		if (entry->nameLength != nameLength)
+			continue;
+
+		const char* entryName = names + entry->nameOffset;
+		size_t i = 0;
+		while (i < nameLength && normalizeArchiveChar(name[i]) == entryName[i])
+			i++;
+
+		if (i != nameLength)
+			continue;
+
+		if (entry->compression != ARCHIVE_COMPRESSION_NONE)
+			return decompress(*entry, view);
+
+		view.borrow(archive.getData() + entry->offset, (size_t)entry->size);
+		return true;
+	}
+
+	return false;
+}
+
+bool AssetArchive::decompress(const ArchiveEntry& entry, FileView& view) const
+{
+	const char* source = archive.getData() + entry.offset;
+	char* buffer = view.allocate((size_t)entry.size);
+	if (!buffer)
+		return false;
+
+	bool success = false;
+
+	switch (entry.compression)
+	{
+	case ARCHIVE_COMPRESSION_LZ4:
+#ifdef OPENFLIGHT_LZ4
+		success = LZ4_decompress_safe(source, buffer, (int)entry.storedSize, (int)entry.size) == (int)entry.size;
+#endif
+		break;
+	case ARCHIVE_COMPRESSION_ZSTD:
+#ifdef OPENFLIGHT_ZSTD
+		success = ZSTD_decompress(buffer, (size_t)entry.size, source, (size_t)entry.storedSize) == entry.size;
+#endif
+		break;
+	default:
+		break;
+	}
+	(void)source;
+
+	if (!success)
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_ERR, "Failed to decompress archive entry {} (compression {})",
+				std::string(names + entry.nameOffset, entry.nameLength), entry.compression);
+		view.release();
+	}
+
+	return success;
+}
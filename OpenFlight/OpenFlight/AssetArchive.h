@@ -0,0 +1,36 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetArchive.h
+*/
+
+#pragma once
+
+#include "AssetArchiveFormat.h"
+#include "FileManager.h"
+#include "Logger.h"
+
+// A mounted .ofpk archive. The whole archive is a single file view, uncompressed entries
+// are handed out as views straight into it without copying or opening anything else
+class AssetArchive
+{
+public:
+	bool open(FileView&& archiveView, const char* archiveName, Logger* primaryLogger);
+
+	// Looks up name by hash, view borrows from the archive so it must not outlive it.
+	// Compressed entries are decompressed into a buffer owned by the view
+	bool find(const char* name, uint64_t hash, FileView& view) const;
+
+	uint32_t getEntryCount() const { return entryCount; }
+
+private:
+	// Systems
+	Logger* logger = nullptr;
+
+	FileView archive;
+	const ArchiveEntry* entries = nullptr;
+	const char* names = nullptr;
+	uint32_t entryCount = 0;
+
+	bool decompress(const ArchiveEntry& entry, FileView& view) const;
+};
\ No newline at end of file
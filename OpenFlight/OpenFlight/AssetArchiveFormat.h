@@ -0,0 +1,75 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetArchiveFormat.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// -- ASSET ARCHIVE FORMAT --
+// ArchiveHeader at offset 0, then every file's data starting on an ARCHIVE_ALIGNMENT boundary,
+// then the directory (ArchiveEntry array sorted by hash) and the names the entries point into.
+// Everything is little endian, written by the AssetPacker tool.
+const char ARCHIVE_MAGIC[4] = { 'O', 'F', 'P', 'K' };
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+enum archiveCompression {
+	ARCHIVE_COMPRESSION_NONE = 0,
+	ARCHIVE_COMPRESSION_LZ4 = 1,
+	ARCHIVE_COMPRESSION_ZSTD = 2,
+};
+
+struct ArchiveHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t directoryOffset;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+};
+
+struct ArchiveEntry
+{
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t storedSize;	// Size inside the archive, differs from size when compressed
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint32_t compression;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(ArchiveHeader) == 40, "ArchiveHeader must match the on disk layout");
+static_assert(sizeof(ArchiveEntry) == 48, "ArchiveEntry must match the on disk layout");
+
+// Archive names use forward slashes and are case insensitive, "Shaders\Basic.vert" and "shaders/basic.vert" are the same entry
+inline char normalizeArchiveChar(char c)
+{
+	if (c == '\\')
+		return '/';
+	if (c >= 'A' && c <= 'Z')
+		return (char)(c - 'A' + 'a');
+
+	return c;
+}
+
+// 64 bit FNV-1a over the normalized name
+inline uint64_t hashArchiveName(const char* name, size_t length)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)normalizeArchiveChar(name[i]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
\ No newline at end of file
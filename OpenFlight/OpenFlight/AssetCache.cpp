@@ -0,0 +1,272 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetCache.cpp
+*/
+
+#include "AssetCache.h"
+#include "FileManager.h"
+
+struct AssetCacheEntry
+{
+	std::string path;
+	FileView view;
+	uint32_t refCount = 0;
+	bool detached = false;	// Invalidated while pinned, deleted when the last handle goes
+	std::list<AssetCacheEntry*>::iterator lruPosition;	// Only valid while refCount is 0
+};
+
+// -- ASSET HANDLE --
+
+AssetHandle::AssetHandle()
+	: cache(nullptr), entry(nullptr), data(nullptr), size(0)
+{
+}
+
+AssetHandle::~AssetHandle()
+{
+	release();
+}
+
+AssetHandle::AssetHandle(const AssetHandle& other)
+	: cache(other.cache), entry(other.entry), data(other.data), size(other.size)
+{
+	if (entry)
+		cache->addRef(entry);
+}
+
+AssetHandle& AssetHandle::operator=(const AssetHandle& other)
+{
+	if (this != &other)
+	{
+		if (other.entry)
+			other.cache->addRef(other.entry);
+
+		release();
+
+		cache = other.cache;
+		entry = other.entry;
+		data = other.data;
+		size = other.size;
+	}
+
+	return *this;
+}
+
+AssetHandle::AssetHandle(AssetHandle&& other) noexcept
+	: cache(other.cache), entry(other.entry), data(other.data), size(other.size)
+{
+	other.cache = nullptr;
+	other.entry = nullptr;
+	other.data = nullptr;
+	other.size = 0;
+}
+
+AssetHandle& AssetHandle::operator=(AssetHandle&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+
+		cache = other.cache;
+		entry = other.entry;
+		data = other.data;
+		size = other.size;
+
+		other.cache = nullptr;
+		other.entry = nullptr;
+		other.data = nullptr;
+		other.size = 0;
+	}
+
+	return *this;
+}
+
+void AssetHandle::release()
+{
+	if (entry)
+		cache->releaseRef(entry);
+
+	cache = nullptr;
+	entry = nullptr;
+	data = nullptr;
+	size = 0;
+}
+
+// -- ASSET CACHE --
+
+AssetCache::AssetCache()
+	: budget(0), stats()
+{
+}
+
+AssetCache::~AssetCache()
+{
+}
+
+void AssetCache::setBudget(size_t budgetBytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	budget = budgetBytes;
+	stats.budgetBytes = budgetBytes;
+	trim();
+}
+
+AssetHandle AssetCache::find(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(path);
+	if (it == entries.end())
+	{
+		stats.misses++;
+		return AssetHandle();
+	}
+
+	stats.hits++;
+
+	return makeHandle(it->second.get());
+}
+
+AssetHandle AssetCache::insert(const std::string& path, FileView&& view)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Two loads of the same file raced, keep the first one
+	auto it = entries.find(path);
+	if (it != entries.end())
+		return makeHandle(it->second.get());
+
+	std::unique_ptr<AssetCacheEntry> entry(new AssetCacheEntry());
+	entry->path = path;
+	entry->view = std::move(view);
+
+	AssetCacheEntry* newEntry = entry.get();
+	entries.emplace(path, std::move(entry));
+
+	lru.push_front(newEntry);
+	newEntry->lruPosition = lru.begin();
+
+	stats.entries++;
+	stats.usedBytes += newEntry->view.getSize();
+	if (stats.usedBytes > stats.peakBytes)
+		stats.peakBytes = stats.usedBytes;
+
+	// Pin before trimming so the new entry cannot be evicted straight away
+	AssetHandle handle = makeHandle(newEntry);
+	trim();
+
+	return handle;
+}
+
+void AssetCache::invalidate(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(path);
+	if (it == entries.end())
+		return;
+
+	AssetCacheEntry* entry = it->second.get();
+	if (entry->refCount > 0)
+	{
+		// Still in use, hand ownership to the handles
+		entry->detached = true;
+		it->second.release();
+		entries.erase(it);
+		return;
+	}
+
+	lru.erase(entry->lruPosition);
+	stats.usedBytes -= entry->view.getSize();
+	stats.entries--;
+	entries.erase(it);
+}
+
+void AssetCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (AssetCacheEntry* entry : lru)
+	{
+		stats.usedBytes -= entry->view.getSize();
+		stats.entries--;
+		entries.erase(entries.find(entry->path));
+	}
+	lru.clear();
+}
+
+AssetCacheStats AssetCache::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return stats;
+}
+
+AssetHandle AssetCache::makeHandle(AssetCacheEntry* entry)
+{
+	// Called with the mutex held
+	if (entry->refCount++ == 0)
+	{
+		lru.erase(entry->lruPosition);
+		stats.pinnedEntries++;
+	}
+
+	AssetHandle handle;
+	handle.cache = this;
+	handle.entry = entry;
+	handle.data = entry->view.getData();
+	handle.size = entry->view.getSize();
+
+	return handle;
+}
+
+void AssetCache::addRef(AssetCacheEntry* entry)
+{
+	// Only reached through an existing handle, so the entry is already pinned
+	std::lock_guard<std::mutex> lock(mutex);
+
+	entry->refCount++;
+}
+
+void AssetCache::releaseRef(AssetCacheEntry* entry)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (--entry->refCount > 0)
+		return;
+
+	stats.pinnedEntries--;
+
+	if (entry->detached)
+	{
+		stats.usedBytes -= entry->view.getSize();
+		stats.entries--;
+		delete entry;
+		return;
+	}
+
+	lru.push_front(entry);
+	entry->lruPosition = lru.begin();
+
+	trim();
+}
+
+void AssetCache::trim()
+{
+	// Called with the mutex held
+	while (stats.usedBytes > budget && !lru.empty())
+	{
+		AssetCacheEntry* entry = lru.back();
+		lru.pop_back();
+
+		stats.evictions++;
+		stats.evictedBytes += entry->view.getSize();
+		stats.usedBytes -= entry->view.getSize();
+		stats.entries--;
+
+		// Erase by iterator, the key passed in would be destroyed along with the entry
+		entries.erase(entries.find(entry->path));
+	}
+}
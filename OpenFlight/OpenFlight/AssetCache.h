@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AssetCache.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class FileView;
+class AssetCache;
+struct AssetCacheEntry;
+
+struct AssetCacheStats
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t evictedBytes;
+	uint32_t entries;
+	uint32_t pinnedEntries;
+	size_t usedBytes;		// Includes pinned entries, so it can go over the budget
+	size_t peakBytes;
+	size_t budgetBytes;
+};
+
+// Reference counted handle to a cached file. The entry is pinned while any handle to it exists,
+// the data stays valid until the last handle is released. Handles must be released before the cache is cleared
+class AssetHandle
+{
+public:
+	AssetHandle();
+	~AssetHandle();
+
+	AssetHandle(const AssetHandle& other);
+	AssetHandle& operator=(const AssetHandle& other);
+	AssetHandle(AssetHandle&& other) noexcept;
+	AssetHandle& operator=(AssetHandle&& other) noexcept;
+
+	const char* getData() const { return data; }
+	size_t getSize() const { return size; }
+	bool isValid() const { return entry != nullptr; }
+
+	explicit operator bool() const { return isValid(); }
+
+	void release();
+
+private:
+	friend class AssetCache;
+
+	AssetCache* cache;
+	AssetCacheEntry* entry;
+	const char* data;
+	size_t size;
+};
+
+// Keeps the contents of recently used files around, keyed by path. Unpinned entries are kept in
+// least recently used order and the oldest are evicted whenever the total size goes over the budget.
+// Thread safe, handles may be copied and released from any thread
+class AssetCache
+{
+public:
+	AssetCache();
+	~AssetCache();
+
+	void setBudget(size_t budgetBytes);
+
+	// Returns an invalid handle and counts a miss if path is not cached
+	AssetHandle find(const std::string& path);
+
+	// Takes ownership of the view and returns a handle to it. If path is already cached
+	// the existing entry wins and the view is discarded
+	AssetHandle insert(const std::string& path, FileView&& view);
+
+	// Drops the entry for path so the next load reads it again. Existing handles keep the old data
+	void invalidate(const std::string& path);
+
+	// Drops every unpinned entry
+	void clear();
+
+	AssetCacheStats getStats();
+
+private:
+	friend class AssetHandle;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, std::unique_ptr<AssetCacheEntry>> entries;
+	std::list<AssetCacheEntry*> lru;	// Unpinned entries only, most recently used first
+
+	size_t budget;
+	AssetCacheStats stats;
+
+	AssetHandle makeHandle(AssetCacheEntry* entry);
+	void addRef(AssetCacheEntry* entry);
+	void releaseRef(AssetCacheEntry* entry);
+	void trim();
+};
\ No newline at end of file
@@ -0,0 +1,496 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AsyncFileLoader.cpp
+*/
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define OPENFLIGHT_IO_URING 1
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "AsyncFileLoader.h"
+#include "FileManager.h"
+
+struct AsyncFileOp
+{
+	std::string path;
+	uint64_t offset;
+	uint64_t size;
+	FileCallback callback;
+	std::unique_ptr<std::promise<FileView>> promise;
+
+	FileView view;
+	uint64_t done;
+	int fd;
+	std::chrono::steady_clock::time_point submitTime;
+};
+
+// Largest single read handed to the kernel, bigger requests are split up
+const uint64_t ASYNC_MAX_READ = 1 << 30;
+
+// Reads [offset, offset + size) of a file into the op's view with plain blocking IO
+bool AsyncFileLoader::readRange(AsyncFileOp& op)
+{
+	FILE* file = fopen(op.path.c_str(), "rb");
+	if (!file)
+		return false;
+
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	int64_t fileSize = _ftelli64(file);
+	_fseeki64(file, (int64_t)op.offset, SEEK_SET);
+#else
+	fseeko(file, 0, SEEK_END);
+	int64_t fileSize = (int64_t)ftello(file);
+	fseeko(file, (off_t)op.offset, SEEK_SET);
+#endif
+
+	if (fileSize < 0 || op.offset > (uint64_t)fileSize)
+	{
+		fclose(file);
+		return false;
+	}
+
+	uint64_t size = (uint64_t)fileSize - op.offset;
+	if (op.size != 0 && op.size < size)
+		size = op.size;
+
+	char* buffer = op.view.allocate((size_t)size);
+	if (!buffer)
+	{
+		fclose(file);
+		return false;
+	}
+
+	size_t count = fread(buffer, 1, (size_t)size, file);
+	fclose(file);
+
+	return count == size;
+}
+
+AsyncFileLoader::AsyncFileLoader()
+	: logger(nullptr), running(false), queueDepth(0), uring(nullptr), stats(), inFlightSamples(0), inFlightSampleSum(0), latencySumMs(0.0)
+{
+	stats.backend = "none";
+}
+
+AsyncFileLoader::~AsyncFileLoader()
+{
+	cleanup();
+}
+
+bool AsyncFileLoader::init(Logger* primaryLogger, unsigned int threadCount, unsigned int depth)
+{
+	logger = primaryLogger;
+	queueDepth = depth > 0 ? depth : 1;
+	running = true;
+
+#ifdef OPENFLIGHT_IO_URING
+	uring = new io_uring();
+	if (io_uring_queue_init(queueDepth, uring, 0) == 0)
+	{
+		stats.backend = "io_uring";
+		threads.emplace_back(&AsyncFileLoader::ioUringLoop, this);
+
+		return true;
+	}
+
+	delete uring;
+	uring = nullptr;
+
+	if (logger)
+		OF_LOG(*logger, LOG_LVL_WRN, "io_uring is not available, falling back to threaded file loading");
+#endif
+
+	// Without io_uring the number of reads in flight is just the number of threads
+	if (threadCount == 0)
+		threadCount = 1;
+
+	stats.backend = "thread pool";
+	for (unsigned int i = 0; i < threadCount; i++)
+		threads.emplace_back(&AsyncFileLoader::workerLoop, this);
+
+	return true;
+}
+
+void AsyncFileLoader::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		running = false;
+	}
+	pendingWake.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+
+	// Requests that never started, let anyone waiting on a future see a failed read
+	for (std::unique_ptr<AsyncFileOp>& op : pending)
+	{
+		if (op->promise)
+			op->promise->set_value(FileView());
+	}
+	pending.clear();
+
+#ifdef OPENFLIGHT_IO_URING
+	if (uring)
+	{
+		io_uring_queue_exit(uring);
+		delete uring;
+		uring = nullptr;
+	}
+#endif
+
+	// Nobody is going to poll for these any more
+	std::lock_guard<std::mutex> lock(completedMutex);
+	completed.clear();
+}
+
+void AsyncFileLoader::submit(std::vector<FileRequest>& requests)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+
+		for (FileRequest& request : requests)
+		{
+			std::unique_ptr<AsyncFileOp> op(new AsyncFileOp());
+			op->path = std::move(request.path);
+			op->offset = request.offset;
+			op->size = request.size;
+			op->callback = std::move(request.callback);
+			op->done = 0;
+			op->fd = -1;
+			op->submitTime = now;
+
+			pending.push_back(std::move(op));
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.submitted += requests.size();
+		stats.queued += (uint32_t)requests.size();
+	}
+
+	requests.clear();
+	pendingWake.notify_all();
+}
+
+std::future<FileView> AsyncFileLoader::submit(const std::string& path, uint64_t offset, uint64_t size)
+{
+	std::unique_ptr<AsyncFileOp> op(new AsyncFileOp());
+	op->path = path;
+	op->offset = offset;
+	op->size = size;
+	op->promise.reset(new std::promise<FileView>());
+	op->done = 0;
+	op->fd = -1;
+	op->submitTime = std::chrono::steady_clock::now();
+
+	std::future<FileView> future = op->promise->get_future();
+	enqueue(std::move(op));
+
+	return future;
+}
+
+void AsyncFileLoader::submitCompleted(FileRequest& request, FileView&& view)
+{
+	if (!request.callback)
+		return;
+
+	std::unique_ptr<AsyncFileOp> op(new AsyncFileOp());
+	op->path = std::move(request.path);
+	op->callback = std::move(request.callback);
+	op->view = std::move(view);
+	op->fd = -1;
+
+	std::lock_guard<std::mutex> lock(completedMutex);
+	completed.push_back(std::move(op));
+}
+
+void AsyncFileLoader::pollCompletions()
+{
+	std::vector<std::unique_ptr<AsyncFileOp>> finished;
+	{
+		std::lock_guard<std::mutex> lock(completedMutex);
+		finished.swap(completed);
+	}
+
+	for (std::unique_ptr<AsyncFileOp>& op : finished)
+		op->callback(op->path, op->view);
+}
+
+AsyncFileStats AsyncFileLoader::getStats()
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+
+	AsyncFileStats result = stats;
+	result.averageInFlight = inFlightSamples ? (double)inFlightSampleSum / inFlightSamples : 0.0;
+	result.averageLatencyMs = (stats.completed + stats.failed) ? latencySumMs / (stats.completed + stats.failed) : 0.0;
+
+	// Include the current busy period so the numbers are live while loading
+	if (stats.inFlight > 0)
+		result.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - busyStart).count();
+
+	return result;
+}
+
+void AsyncFileLoader::enqueue(std::unique_ptr<AsyncFileOp> op)
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pending.push_back(std::move(op));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.submitted++;
+		stats.queued++;
+	}
+
+	pendingWake.notify_one();
+}
+
+void AsyncFileLoader::workerLoop()
+{
+	for (;;)
+	{
+		std::unique_ptr<AsyncFileOp> op;
+		{
+			std::unique_lock<std::mutex> lock(pendingMutex);
+			pendingWake.wait(lock, [this] { return !pending.empty() || !running; });
+
+			if (!running)
+				break;
+
+			op = std::move(pending.front());
+			pending.pop_front();
+		}
+
+		beginRead();
+		bool success = readRange(*op);
+		finish(std::move(op), success);
+	}
+}
+
+#ifdef OPENFLIGHT_IO_URING
+
+// Queues the next read of an op, the ring keeps the op until it completes. Fails when the submission queue
+// stays full even after handing its entries to the kernel, the op is left with the caller then
+bool AsyncFileLoader::queueRead(std::unique_ptr<AsyncFileOp>& op)
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(uring);
+	if (!sqe && io_uring_submit(uring) >= 0)
+		sqe = io_uring_get_sqe(uring);
+
+	if (!sqe)
+		return false;
+
+	io_uring_prep_read(sqe, op->fd, op->view.buffer.get() + op->done, (unsigned int)std::min(op->size - op->done, ASYNC_MAX_READ), op->offset + op->done);
+	io_uring_sqe_set_data(sqe, op.release());
+	return true;
+}
+
+void AsyncFileLoader::ioUringLoop()
+{
+	unsigned int active = 0;
+
+	// Active ops whose next read found no free submission entry, retried on the next pass
+	std::vector<std::unique_ptr<AsyncFileOp>> stalled;
+
+	// Reads sitting in the submission queue, kept until a submit goes through
+	bool queued = false;
+
+	for (;;)
+	{
+		std::vector<std::unique_ptr<AsyncFileOp>> issue;
+		{
+			std::unique_lock<std::mutex> lock(pendingMutex);
+
+			// Only sleep on the condition variable when there is nothing to reap
+			if (active == 0)
+				pendingWake.wait(lock, [this] { return !pending.empty() || !running; });
+
+			if (!running && active == 0)
+				break;
+
+			while (running && !pending.empty() && active + issue.size() < queueDepth)
+			{
+				issue.push_back(std::move(pending.front()));
+				pending.pop_front();
+			}
+		}
+
+		std::vector<std::unique_ptr<AsyncFileOp>> retry;
+		retry.swap(stalled);
+		for (std::unique_ptr<AsyncFileOp>& op : retry)
+		{
+			if (queueRead(op))
+				queued = true;
+			else
+				stalled.push_back(std::move(op));
+		}
+
+		for (std::unique_ptr<AsyncFileOp>& op : issue)
+		{
+			// The open itself is still synchronous, only the reads go through the ring
+			struct stat info;
+			op->fd = open(op->path.c_str(), O_RDONLY);
+			if (op->fd < 0 || fstat(op->fd, &info) != 0 || op->offset > (uint64_t)info.st_size)
+			{
+				beginRead();
+				finish(std::move(op), false);
+				continue;
+			}
+
+			uint64_t size = (uint64_t)info.st_size - op->offset;
+			if (op->size != 0 && op->size < size)
+				size = op->size;
+
+			if (!op->view.allocate((size_t)size))
+			{
+				beginRead();
+				finish(std::move(op), false);
+				continue;
+			}
+			op->size = size;
+
+			beginRead();
+			active++;
+
+			if (queueRead(op))
+				queued = true;
+			else
+				stalled.push_back(std::move(op));
+		}
+
+		if (queued)
+			queued = io_uring_submit(uring) < 0;
+
+		if (active == 0)
+			continue;
+
+		// Wake up regularly to pick up new requests even while reads are outstanding
+		io_uring_cqe* cqe = nullptr;
+		__kernel_timespec timeout = { 0, 1000000 };
+		if (io_uring_wait_cqe_timeout(uring, &cqe, &timeout) != 0)
+			continue;
+
+		while (io_uring_peek_cqe(uring, &cqe) == 0)
+		{
+			std::unique_ptr<AsyncFileOp> op((AsyncFileOp*)io_uring_cqe_get_data(cqe));
+			int result = cqe->res;
+			io_uring_cqe_seen(uring, cqe);
+
+			if (result > 0)
+				op->done += (uint64_t)result;
+
+			if (result > 0 && op->done < op->size)
+			{
+				// Short or split read, queue the rest
+				if (queueRead(op))
+					queued = true;
+				else
+					stalled.push_back(std::move(op));
+				continue;
+			}
+
+			bool success = result >= 0 && op->done == op->size;
+			active--;
+			finish(std::move(op), success);
+		}
+
+		if (queued)
+			queued = io_uring_submit(uring) < 0;
+	}
+}
+
+#else
+
+bool AsyncFileLoader::queueRead(std::unique_ptr<AsyncFileOp>&)
+{
+	return false;
+}
+
+void AsyncFileLoader::ioUringLoop()
+{
+}
+
+#endif
+
+void AsyncFileLoader::beginRead()
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+
+	if (stats.inFlight == 0)
+		busyStart = std::chrono::steady_clock::now();
+
+	stats.queued--;
+	stats.inFlight++;
+	if (stats.inFlight > stats.peakInFlight)
+		stats.peakInFlight = stats.inFlight;
+
+	inFlightSamples++;
+	inFlightSampleSum += stats.inFlight;
+}
+
+void AsyncFileLoader::finish(std::unique_ptr<AsyncFileOp> op, bool success)
+{
+#ifdef OPENFLIGHT_IO_URING
+	if (op->fd >= 0)
+		close(op->fd);
+#endif
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		if (success)
+		{
+			stats.completed++;
+			stats.bytesRead += op->view.getSize();
+		}
+		else
+		{
+			stats.failed++;
+		}
+
+		latencySumMs += std::chrono::duration<double, std::milli>(now - op->submitTime).count();
+
+		stats.inFlight--;
+		if (stats.inFlight == 0)
+			stats.busySeconds += std::chrono::duration<double>(now - busyStart).count();
+	}
+
+	if (!success)
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_ERR, "Failed to read file {}", op->path);
+		op->view.release();
+	}
+
+	// Futures are fulfilled right away, callbacks wait for the main thread
+	if (op->promise)
+	{
+		op->promise->set_value(std::move(op->view));
+		return;
+	}
+
+	if (op->callback)
+	{
+		std::lock_guard<std::mutex> lock(completedMutex);
+		completed.push_back(std::move(op));
+	}
+}
@@ -0,0 +1,107 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* AsyncFileLoader.h
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+
+class FileView;
+
+// Called on the main thread from FileManager::pollCompletions, view is invalid if the read failed
+typedef std::function<void(const std::string& path, FileView& view)> FileCallback;
+
+struct FileRequest
+{
+	std::string path;
+	uint64_t offset = 0;
+	uint64_t size = 0;	// 0 reads everything from offset to the end of the file
+	FileCallback callback;
+};
+
+struct AsyncFileStats
+{
+	const char* backend;
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t failed;
+	uint64_t bytesRead;
+	uint32_t queued;			// Waiting for a free slot
+	uint32_t inFlight;			// Currently being read
+	uint32_t peakInFlight;
+	double averageInFlight;		// Sampled every time a read is issued
+	double averageLatencyMs;	// Submission to completion
+	double busySeconds;			// Time with at least one read in flight, bytesRead / busySeconds is the throughput
+};
+
+struct AsyncFileOp;
+struct io_uring;
+
+// Reads batches of files in the background. On Linux builds with liburing a single thread keeps up to
+// queueDepth reads in flight through io_uring, everywhere else a pool of worker threads does blocking reads.
+class AsyncFileLoader
+{
+public:
+	AsyncFileLoader();
+	~AsyncFileLoader();
+
+	bool init(Logger* primaryLogger, unsigned int threadCount, unsigned int queueDepth);
+	void cleanup();
+
+	void submit(std::vector<FileRequest>& requests);
+	std::future<FileView> submit(const std::string& path, uint64_t offset, uint64_t size);
+
+	// Queues the callback of a request whose data is already available (e.g. from an archive)
+	void submitCompleted(FileRequest& request, FileView&& view);
+
+	// Runs the callbacks of every finished request, must be called from the main thread
+	void pollCompletions();
+
+	AsyncFileStats getStats();
+
+private:
+	// Systems
+	Logger* logger;
+
+	bool running;
+	unsigned int queueDepth;
+	io_uring* uring;
+	std::vector<std::thread> threads;
+
+	std::mutex pendingMutex;
+	std::condition_variable pendingWake;
+	std::deque<std::unique_ptr<AsyncFileOp>> pending;
+
+	std::mutex completedMutex;
+	std::vector<std::unique_ptr<AsyncFileOp>> completed;
+
+	// Stats, guarded by statsMutex
+	std::mutex statsMutex;
+	AsyncFileStats stats;
+	uint64_t inFlightSamples;
+	uint64_t inFlightSampleSum;
+	double latencySumMs;
+	std::chrono::steady_clock::time_point busyStart;
+
+	void enqueue(std::unique_ptr<AsyncFileOp> op);
+	static bool readRange(AsyncFileOp& op);
+	void workerLoop();
+	bool queueRead(std::unique_ptr<AsyncFileOp>& op);
+	void ioUringLoop();
+	void beginRead();
+	void finish(std::unique_ptr<AsyncFileOp> op, bool success);
+};
\ No newline at end of file
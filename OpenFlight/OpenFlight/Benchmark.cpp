@@ -0,0 +1,508 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* Benchmark.cpp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+
+const uint32_t BENCHMARK_COUNTS[] = { 10000, 100000, 1000000 };
+const uint32_t BENCHMARK_WARMUP_FRAMES = 3;
+const uint32_t BENCHMARK_FRAMES = 20;
+
+const uint32_t CULL_BENCHMARK_SPHERES = 1000000;
+const uint32_t CULL_BENCHMARK_THREADS[] = { 1, 4, 16 };
+const uint32_t CULL_BENCHMARK_RUNS = 20;
+
+const uint32_t LOG_BENCHMARK_THREADS[] = { 1, 2, 4, 8 };
+const uint32_t LOG_BENCHMARK_CALLS = 20000;
+const char* const LOG_BENCHMARK_FILE = "OpenFlightBenchmark.log";
+
+const uint32_t LOG_FORMAT_BENCHMARK_CALLS = 10000;
+
+const uint32_t CONSOLE_BENCHMARK_LINES = 20000;
+const uint32_t CONSOLE_BENCHMARK_BATCH = 64;
+
+const size_t READ_BENCHMARK_SIZES[] = { 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 256 * 1024 * 1024, 1024 * 1024 * 1024 };
+const size_t READ_BENCHMARK_BYTES = 1024 * 1024 * 1024;	// Read per size and path, at least 3 reads each
+const char* const READ_BENCHMARK_FILE = "OpenFlightBenchmark.bin";
+
+// Sum of the touched bytes, keeps the reads from being optimised away
+static volatile uint32_t readChecksum = 0;
+
+// Objects laid out in a square grid covering the screen, each scaled to its cell
+static void makeGrid(uint32_t count, std::vector<InstanceData>& instances)
+{
+	uint32_t side = (uint32_t)std::ceil(std::sqrt((double)count));
+	float cell = 2.0f / side;
+
+	instances.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t x = i % side;
+		uint32_t y = i / side;
+
+		InstanceData& instance = instances[i];
+		float* m = instance.transform;
+		for (uint32_t j = 0; j < 16; j++)
+			m[j] = 0.0f;
+
+		// Column major, a scale and a translation
+		m[0] = cell;
+		m[5] = cell;
+		m[10] = 1.0f;
+		m[12] = -1.0f + (x + 0.5f) * cell;
+		m[13] = -1.0f + (y + 0.5f) * cell;
+		m[15] = 1.0f;
+
+		instance.color[0] = (float)x / side;
+		instance.color[1] = (float)y / side;
+		instance.color[2] = 0.5f;
+		instance.color[3] = 1.0f;
+	}
+}
+
+// Average milliseconds per frame, with whatever was submitted by submitFrame
+template<typename SubmitFrame>
+static double timeFrames(Renderer* renderer, GLFWwindow* window, SubmitFrame submitFrame)
+{
+	double totalMs = 0.0;
+	for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		renderer->clearScreen(0.0f, 0.0f, 0.0f, 1.0f);
+		submitFrame();
+		renderer->render();
+		glFinish();
+
+		if (frame >= BENCHMARK_WARMUP_FRAMES)
+			totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		glfwPollEvents();
+		glfwSwapBuffers(window);
+	}
+
+	return totalMs / BENCHMARK_FRAMES;
+}
+
+void runInstancingBenchmark(Logger* logger, Renderer* renderer, ShaderManager* shaderManager, GLFWwindow* window)
+{
+	const float vertices[] = {
+		-0.4f, -0.4f, 0.0f,
+		 0.4f, -0.4f, 0.0f,
+		 0.0f,  0.4f, 0.0f
+	};
+	const uint32_t indices[] = { 0, 1, 2 };
+
+	VertexLayout layout;
+	layout.components[VERTEX_POSITION] = 3;
+	MeshHandle mesh = renderer->getMeshes().createMesh(layout, vertices, 3, indices, 3);
+
+	ShaderHandle shader = shaderManager->loadProgram("vertexShader.vert", "fragmentShader.frag");
+	ShaderHandle instancedShader = shaderManager->loadProgram("vertexShader.vert", "fragmentShader.frag", SHADER_FEATURE_INSTANCED);
+	shaderManager->finishLoading();
+
+	if (!shaderManager->getProgram(shader) || !shaderManager->getProgram(instancedShader))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Instancing benchmark shaders failed to build");
+		return;
+	}
+
+	InstanceBucketHandle bucket = renderer->addInstanceBucket(mesh, instancedShader, 0);
+
+	glfwSwapInterval(0);
+
+	std::vector<InstanceData> instances;
+	for (uint32_t count : BENCHMARK_COUNTS)
+	{
+		makeGrid(count, instances);
+
+		// One draw item per object, each with its own transform upload
+		DrawItem item;
+		item.shader = shader;
+		renderer->setMesh(item, mesh);
+
+		double naiveMs = timeFrames(renderer, window, [&]() {
+			for (const InstanceData& instance : instances)
+			{
+				memcpy(item.transform, instance.transform, sizeof(item.transform));
+				renderer->submit(item);
+			}
+		});
+		RenderQueueStats naiveStats = renderer->getQueueStats();
+
+		// Uploaded once by the first frame, every frame after that is a single draw
+		renderer->setInstances(bucket, instances.data(), count);
+		double instancedMs = timeFrames(renderer, window, []() {});
+		RenderQueueStats instancedStats = renderer->getQueueStats();
+		renderer->clearInstances(bucket);
+
+		// One indirect command per object, as if each had its own mesh
+		double indirectMs = timeFrames(renderer, window, [&]() {
+			for (const InstanceData& instance : instances)
+				renderer->submitIndirect(instancedShader, mesh, &instance, 1);
+		});
+		IndirectStats indirectStats = renderer->getIndirectStats();
+
+		OF_LOG(*logger, LOG_LVL_INFO, "Instancing benchmark, {} objects: {} ms per frame with {} draws, {} ms instanced with {} draws ({}x)",
+			count, naiveMs, naiveStats.draws, instancedMs, instancedStats.draws, naiveMs / instancedMs);
+		OF_LOG(*logger, LOG_LVL_INFO, "Indirect benchmark, {} objects: {} ms per frame, {} commands in {} draw calls{}, {} ms CPU submit",
+			count, indirectMs, indirectStats.commands, indirectStats.drawCalls, indirectStats.multiDraw ? "" : " (fallback loop)", indirectStats.submitMs);
+	}
+
+	glfwSwapInterval(1);
+	renderer->getMeshes().destroyMesh(mesh);
+}
+
+// Average milliseconds per cull of every sphere set in culler, after one run to warm the caches
+static double timeCulls(FrustumCuller& culler, const float* viewProjection, std::vector<uint32_t>& visible)
+{
+	culler.cull(viewProjection, visible);
+
+	double totalMs = 0.0;
+	for (uint32_t run = 0; run < CULL_BENCHMARK_RUNS; run++)
+	{
+		culler.cull(viewProjection, visible);
+		totalMs += culler.getStats().cullMs;
+	}
+
+	return totalMs / CULL_BENCHMARK_RUNS;
+}
+
+void runCullingBenchmark(Logger* logger)
+{
+	// Column major perspective, 60 degree vertical field of view at 16:9 looking down -z from the origin
+	const float nearPlane = 0.1f;
+	const float farPlane = 1000.0f;
+	const float focal = 1.0f / std::tan(0.5f * 1.0471976f);
+
+	float viewProjection[16] = {};
+	viewProjection[0] = focal * 9.0f / 16.0f;
+	viewProjection[5] = focal;
+	viewProjection[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+	viewProjection[11] = -1.0f;
+	viewProjection[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+
+	// Spread all around the camera, so only a small part of them ends up inside
+	std::vector<float> spheres(CULL_BENCHMARK_SPHERES * 4);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-farPlane, farPlane);
+	std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+	for (uint32_t i = 0; i < CULL_BENCHMARK_SPHERES * 4; i += 4)
+	{
+		spheres[i] = position(random);
+		spheres[i + 1] = position(random);
+		spheres[i + 2] = position(random);
+		spheres[i + 3] = radius(random);
+	}
+
+	auto setSpheres = [&](FrustumCuller& culler) {
+		culler.resize(CULL_BENCHMARK_SPHERES);
+		for (uint32_t i = 0; i < CULL_BENCHMARK_SPHERES; i++)
+			culler.setSphere(i, spheres[i * 4], spheres[i * 4 + 1], spheres[i * 4 + 2], spheres[i * 4 + 3]);
+	};
+
+	FrustumCuller culler;
+	culler.init(logger, nullptr);
+	setSpheres(culler);
+
+	std::vector<uint32_t> visible;
+	cullKernel bestKernel = FrustumCuller::getBestKernel();
+
+	for (int kernel = CULL_KERNEL_SCALAR; kernel <= bestKernel; kernel++)
+	{
+		culler.setKernel((cullKernel)kernel);
+		double ms = timeCulls(culler, viewProjection, visible);
+
+		OF_LOG(*logger, LOG_LVL_INFO, "Culling benchmark, {} objects with the {} kernel on 1 thread: {} ms, {} objects per ms, {} visible",
+			CULL_BENCHMARK_SPHERES, cullKernelNames[kernel], ms, CULL_BENCHMARK_SPHERES / ms, visible.size());
+	}
+
+	culler.cleanup();
+
+	for (uint32_t threads : CULL_BENCHMARK_THREADS)
+	{
+		// The calling thread is one of them, a single thread runs without a job system at all
+		JobSystem jobs;
+		if (threads > 1 && !jobs.init(logger, threads - 1))
+			continue;
+
+		FrustumCuller threadedCuller;
+		threadedCuller.init(logger, threads > 1 ? &jobs : nullptr);
+		threadedCuller.setKernel(bestKernel);
+		setSpheres(threadedCuller);
+
+		double ms = timeCulls(threadedCuller, viewProjection, visible);
+
+		OF_LOG(*logger, LOG_LVL_INFO, "Culling benchmark, {} objects with the {} kernel on {} threads ({} hardware threads): {} ms, {} objects per ms",
+			CULL_BENCHMARK_SPHERES, cullKernelNames[bestKernel], threads, std::thread::hardware_concurrency(), ms, CULL_BENCHMARK_SPHERES / ms);
+
+		threadedCuller.cleanup();
+		jobs.cleanup();
+	}
+}
+// Every thread logs LOG_BENCHMARK_CALLS formatted messages as fast as it can, timing each call on its own
+static void timeLogCalls(Logger& benchLogger, uint32_t threads, std::vector<double>& latencies)
+{
+	latencies.assign((size_t)threads * LOG_BENCHMARK_CALLS, 0.0);
+
+	std::vector<std::thread> workers;
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&benchLogger, &latencies, t]() {
+			double* threadLatencies = latencies.data() + (size_t)t * LOG_BENCHMARK_CALLS;
+			for (uint32_t i = 0; i < LOG_BENCHMARK_CALLS; i++)
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				benchLogger.logOut(LOG_LVL_INFO, "Benchmark thread {} message {} value {}", t, i, i * 0.5);
+				threadLatencies[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			}
+		});
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	std::sort(latencies.begin(), latencies.end());
+}
+
+void runLoggingBenchmark(Logger* logger)
+{
+	std::vector<double> latencies;
+
+	for (int async = 0; async <= 1; async++)
+	{
+		for (uint32_t threads : LOG_BENCHMARK_THREADS)
+		{
+			// A logger of its own writing only to a file, so the console is not flooded and the main log is untouched
+			LoggerSettings settings;
+			settings.logToConsole = false;
+			settings.logToFile = true;
+			settings.logFileName = LOG_BENCHMARK_FILE;
+			settings.logSegmentSize = 64 * 1024 * 1024;
+			settings.async = async != 0;
+
+			Logger benchLogger;
+			benchLogger.initializeLogging(settings);
+			timeLogCalls(benchLogger, threads, latencies);
+			benchLogger.cleanup();
+
+			double totalNs = 0.0;
+			for (double latency : latencies)
+				totalNs += latency;
+
+			LoggerStats stats = benchLogger.getStats();
+			OF_LOG(*logger, LOG_LVL_INFO, "Logging benchmark, {} on {} threads: {} ns mean, {} ns median, {} ns p99, {} ns max per call, {} written, {} dropped",
+				async ? "async" : "sync", threads, totalNs / latencies.size(), latencies[latencies.size() / 2],
+				latencies[latencies.size() * 99 / 100], latencies.back(), stats.written, stats.dropped);
+		}
+	}
+
+	std::remove(LOG_BENCHMARK_FILE);
+}
+
+// Average nanoseconds per call of logCall over LOG_FORMAT_BENCHMARK_CALLS calls
+template<typename LogCall>
+static double timeFormattedCalls(LogCall logCall)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < LOG_FORMAT_BENCHMARK_CALLS; i++)
+		logCall(i);
+
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOG_FORMAT_BENCHMARK_CALLS;
+}
+
+void runLogFormatBenchmark(Logger* logger)
+{
+	// Synchronous, so every call pays for its own formatting and output. Warnings only at first, so info calls
+	// are live in every build and only the runtime level check turns them away
+	LoggerSettings settings;
+	settings.logToConsole = false;
+	settings.logToFile = true;
+	settings.logFileName = LOG_BENCHMARK_FILE;
+	settings.logSegmentSize = 64 * 1024 * 1024;
+	settings.fileLevel = LOG_LVL_WRN;
+	settings.async = false;
+
+	Logger benchLogger;
+	benchLogger.initializeLogging(settings);
+
+	double strippedNs = timeFormattedCalls([&](uint32_t i) {
+		OF_LOG(benchLogger, LOG_LVL_DEBUG, "Stripped message {} value {}", i, i * 0.5);
+	});
+	double disabledNs = timeFormattedCalls([&](uint32_t i) {
+		OF_LOG(benchLogger, LOG_LVL_INFO, "Disabled message {} value {}", i, i * 0.5);
+	});
+
+	benchLogger.cleanup();
+	settings.fileLevel = LOG_LVL_INFO;
+	benchLogger.initializeLogging(settings);
+
+	double fileNs = timeFormattedCalls([&](uint32_t i) {
+		OF_LOG(benchLogger, LOG_LVL_INFO, "File message {} value {}", i, i * 0.5);
+	});
+
+	benchLogger.cleanup();
+	settings.binaryFile = true;
+	benchLogger.initializeLogging(settings);
+
+	double binaryNs = timeFormattedCalls([&](uint32_t i) {
+		OF_LOG(benchLogger, LOG_LVL_INFO, "Binary message {} value {}", i, i * 0.5);
+	});
+
+	benchLogger.cleanup();
+	settings.logToConsole = true;
+	settings.logToFile = false;
+	benchLogger.initializeLogging(settings);
+
+	double consoleNs = timeFormattedCalls([&](uint32_t i) {
+		OF_LOG(benchLogger, LOG_LVL_INFO, "Console message {} value {}", i, i * 0.5);
+	});
+
+	benchLogger.cleanup();
+	std::remove(LOG_BENCHMARK_FILE);
+
+	OF_LOG(*logger, LOG_LVL_INFO, "Formatted logging benchmark, {} calls each: {} ns stripped debug site ({}), {} ns disabled level, "
+		"{} ns text file, {} ns binary file, {} ns console", LOG_FORMAT_BENCHMARK_CALLS, strippedNs,
+		LOG_MIN_LEVEL < LOG_LVL_DEBUG ? "compiled out" : "not compiled out in this build", disabledNs, fileNs, binaryNs, consoleNs);
+}
+
+// Lines per second written through console, flushed after every batchSize lines. Levels cycle so the Win32
+// backend has to switch attributes between lines
+static double timeConsoleLines(LogConsole& console, uint32_t batchSize)
+{
+	static const char line[] = "Console benchmark line with a typical amount of text after the level prefix";
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < CONSOLE_BENCHMARK_LINES; i++)
+	{
+		console.write((logLevel)(i % 4), line, sizeof(line) - 1);
+		if ((i + 1) % batchSize == 0)
+			console.flush();
+	}
+	console.flush();
+
+	return CONSOLE_BENCHMARK_LINES / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runConsoleBenchmark(Logger* logger)
+{
+	static const char line[] = "Console benchmark line with a typical amount of text after the level prefix";
+
+	// What every logOut call did before the console backend, one stream insert and flush per line
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < CONSOLE_BENCHMARK_LINES; i++)
+		std::cout << logLevelMsg[i % 4] << line << std::endl;
+	double streamLinesPerSecond = CONSOLE_BENCHMARK_LINES / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double linesPerSecond[2][2] = {};
+	bool backendUsed[2] = {};
+
+	for (int backend = LOG_CONSOLE_ANSI; backend <= LOG_CONSOLE_WIN32; backend++)
+	{
+		// Asking for Win32 outside of Windows, or ANSI on a console without escape codes, falls back to another backend
+		LogConsole console;
+		console.init((logConsoleBackend)backend);
+		if (console.getBackend() != backend)
+			continue;
+
+		backendUsed[backend] = true;
+		linesPerSecond[backend][0] = timeConsoleLines(console, 1);
+		linesPerSecond[backend][1] = timeConsoleLines(console, CONSOLE_BENCHMARK_BATCH);
+	}
+
+	OF_LOG(*logger, LOG_LVL_INFO, "Console benchmark, {} lines each: {} lines/s with std::cout and std::endl", CONSOLE_BENCHMARK_LINES, streamLinesPerSecond);
+
+	for (int backend = LOG_CONSOLE_ANSI; backend <= LOG_CONSOLE_WIN32; backend++)
+	{
+		if (!backendUsed[backend])
+			continue;
+
+		OF_LOG(*logger, LOG_LVL_INFO, "Console benchmark, {} backend: {} lines/s flushed per line, {} lines/s flushed per {} lines",
+			backend == LOG_CONSOLE_ANSI ? "ANSI" : "Win32", linesPerSecond[backend][0], linesPerSecond[backend][1], CONSOLE_BENCHMARK_BATCH);
+	}
+}
+
+// Writes a file of size bytes in 1MB blocks, returns false if the disk could not take all of it
+static bool writeBenchmarkFile(size_t size)
+{
+	FILE* file = fopen(READ_BENCHMARK_FILE, "wb");
+	if (!file)
+		return false;
+
+	std::vector<char> block(1024 * 1024);
+	for (size_t i = 0; i < block.size(); i++)
+		block[i] = (char)(i * 31 + 7);
+
+	size_t written = 0;
+	while (written < size)
+	{
+		size_t length = std::min(block.size(), size - written);
+		if (fwrite(block.data(), 1, length, file) != length)
+			break;
+		written += length;
+	}
+
+	return fclose(file) == 0 && written == size;
+}
+
+// Average milliseconds per readFile of the benchmark file, touching a byte of every page so a mapping pays for
+// its page faults the same as a buffered read pays for its copy
+static double timeReads(FileManager& fileManager, size_t mapThreshold, uint32_t runs, bool& mapped)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t run = 0; run < runs; run++)
+	{
+		FileView view = fileManager.readFile(READ_BENCHMARK_FILE, mapThreshold);
+		for (size_t i = 0; i < view.getSize(); i += 4096)
+			readChecksum += (unsigned char)view.getData()[i];
+		mapped = view.isMapped();
+	}
+
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+void runReadBenchmark(Logger* logger)
+{
+	FileManager fileManager;
+	if (!fileManager.init(logger))
+		return;
+
+	for (size_t size : READ_BENCHMARK_SIZES)
+	{
+		if (!writeBenchmarkFile(size))
+		{
+			OF_LOG(*logger, LOG_LVL_WRN, "Read benchmark, could not write a {} byte file, skipping", size);
+			continue;
+		}
+
+		uint32_t runs = (uint32_t)std::max<size_t>(3, READ_BENCHMARK_BYTES / size);
+		bool mapped = false;
+		bool buffered = false;
+
+		// The first read pulls the file into the page cache, both paths are then timed reading from memory
+		timeReads(fileManager, SIZE_MAX, 1, buffered);
+		double mappedMs = timeReads(fileManager, 0, runs, mapped);
+		double bufferedMs = timeReads(fileManager, SIZE_MAX, runs, buffered);
+
+		double megabytes = size / (1024.0 * 1024.0);
+		OF_LOG(*logger, LOG_LVL_INFO, "Read benchmark, {} KB file over {} reads: {} ms mapped{} ({} MB/s), {} ms buffered ({} MB/s), readFile {} it",
+			size / 1024, runs, mappedMs, mapped ? "" : " (mapping failed)", megabytes / mappedMs * 1000.0, bufferedMs,
+			megabytes / bufferedMs * 1000.0, size >= FileManager::MAP_THRESHOLD ? "maps" : "buffers");
+	}
+
+	std::remove(READ_BENCHMARK_FILE);
+	fileManager.cleanup();
+}
\ No newline at end of file
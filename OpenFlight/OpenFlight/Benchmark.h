@@ -0,0 +1,45 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* Benchmark.h
+*/
+
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include "FileManager.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "Renderer.h"
+#include "ShaderManager.h"
+
+// Draws a grid of 10k, 100k and 1M triangles, once with a draw per object, once instanced and once with an indirect
+// command per object, and logs the average frame time of each. Frames are finished with glFinish so the GPU time is included, and vsync is turned off
+void runInstancingBenchmark(Logger* logger, Renderer* renderer, ShaderManager* shaderManager, GLFWwindow* window);
+
+// Culls 1M random spheres against a perspective frustum with each kernel on one thread, then with the best kernel
+// on 1, 4 and 16 threads, and logs objects culled per millisecond. Thread counts above the hardware's are still
+// run but share cores, so they show the cost of oversubscription rather than more speed. Needs no GL context
+void runCullingBenchmark(Logger* logger);
+
+// Logs from 1, 2, 4 and 8 threads at once into a file, synchronously and through the async writer, and logs the
+// mean, median, p99 and worst latency of a single logOut call. The async runs use the drop policy, so the dropped
+// count shows when the writer could not keep up
+void runLoggingBenchmark(Logger* logger);
+
+// Times formatted OF_LOG calls with the logger synchronous: a debug site that LOG_MIN_LEVEL strips in Release,
+// an info site the file level filters out at runtime, and live calls to a text file, a binary file and the
+// console, then logs the nanoseconds per call of each. The console run prints its messages
+void runLogFormatBenchmark(Logger* logger);
+
+// Writes 20k lines to stdout with std::cout and std::endl like logOut used to, then through every console backend
+// available on this platform, flushed after every line and after every 64 lines like the async writer, and logs
+// lines per second for each. Results depend on where stdout goes, a terminal is far slower than a file or pipe
+void runConsoleBenchmark(Logger* logger);
+
+// Writes files of 4KB up to 1GB and reads each one back through FileManager::readFile, once forced to map it and
+// once forced to read it into a buffer, and logs the time per read of each. Every page of the result is touched so
+// both pay for getting the data into memory. Sizes the disk has no room for are skipped
+void runReadBenchmark(Logger* logger);
\ No newline at end of file
@@ -4,31 +4,447 @@
 * FileManager.cpp
 */
 
-#include <iostream>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <new>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "AssetArchive.h"
 #include "FileManager.h"
-#include "Logger.h"
 
-const char* FileManager::readFile(const char* fileName)
+// -- FILE VIEW --
+
+FileView::FileView()
+	: data(nullptr), size(0), mapped(false)
+{
+}
+
+FileView::~FileView()
+{
+	release();
+}
+
+FileView::FileView(FileView&& other) noexcept
+	: data(other.data), size(other.size), mapped(other.mapped), buffer(std::move(other.buffer))
+{
+	other.data = nullptr;
+	other.size = 0;
+	other.mapped = false;
+}
+
+FileView& FileView::operator=(FileView&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+
+		data = other.data;
+		size = other.size;
+		mapped = other.mapped;
+		buffer = std::move(other.buffer);
+
+		other.data = nullptr;
+		other.size = 0;
+		other.mapped = false;
+	}
+
+	return *this;
+}
+
+void FileView::release()
+{
+	if (mapped && data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap((void*)data, size);
+#endif
+	}
+
+	buffer.reset();
+	data = nullptr;
+	size = 0;
+	mapped = false;
+}
+
+char* FileView::allocate(size_t bufferSize)
+{
+	release();
+
+	buffer.reset(new (std::nothrow) char[bufferSize + 1]);
+	if (!buffer)
+		return nullptr;
+
+	buffer[bufferSize] = '\0';
+	data = buffer.get();
+	size = bufferSize;
+
+	return buffer.get();
+}
+
+void FileView::borrow(const char* borrowedData, size_t borrowedSize)
+{
+	release();
+
+	data = borrowedData;
+	size = borrowedSize;
+}
+
+// -- FILE MANAGER --
+
+// Out of line so AssetArchive can stay incomplete in the header
+FileManager::FileManager()
+{
+}
+
+FileManager::~FileManager()
+{
+}
+
+bool FileManager::init(Logger* primaryLogger)
+{
+	logger = primaryLogger;
+
+	cache.setBudget(CACHE_BUDGET);
+
+	if (!watcher.init(logger))
+		return false;
+
+	return asyncLoader.init(logger, ASYNC_THREADS, ASYNC_QUEUE_DEPTH);
+}
+
+void FileManager::cleanup()
+{
+	asyncLoader.cleanup();
+	watcher.cleanup();
+	pendingAssets.clear();
+	changedFiles.clear();
+
+	// Cached views can borrow archive memory, so the cache goes first
+	cache.clear();
+
+	AssetCacheStats stats = cache.getStats();
+	if (stats.pinnedEntries > 0 && logger)
+		OF_LOG(*logger, LOG_LVL_WRN, "{} cached assets are still in use at cleanup", stats.pinnedEntries);
+
+	archives.clear();
+}
+
+FileView FileManager::readFile(const char* fileName, size_t mapThreshold)
+{
+	FileView view;
+
+	if (!findInArchives(fileName, view) && !readFromDisk(fileName, view, mapThreshold) && logger)
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to read file {}", fileName);
+
+	return view;
+}
+
+AssetHandle FileManager::loadAsset(const char* fileName)
+{
+	AssetHandle handle = cache.find(fileName);
+	if (handle)
+		return handle;
+
+	FileView view = readFile(fileName);
+	if (!view)
+		return handle;
+
+	return cache.insert(fileName, std::move(view));
+}
+
+void FileManager::loadAssetsAsync(const std::vector<std::string>& fileNames, AssetCallback callback)
+{
+	std::vector<FileRequest> requests;
+	for (const std::string& fileName : fileNames)
+	{
+		AssetHandle handle = cache.find(fileName);
+		if (handle)
+		{
+			callback(fileName, handle);
+			continue;
+		}
+
+		std::vector<AssetCallback>& waiting = pendingAssets[fileName];
+		waiting.push_back(callback);
+		if (waiting.size() > 1)
+			continue;
+
+		FileRequest request;
+		request.path = fileName;
+		request.callback = [this](const std::string& path, FileView& view) {
+			AssetHandle handle;
+			if (view)
+				handle = cache.insert(path, std::move(view));
+
+			auto it = pendingAssets.find(path);
+			if (it == pendingAssets.end())
+				return;
+
+			std::vector<AssetCallback> callbacks = std::move(it->second);
+			pendingAssets.erase(it);
+			for (AssetCallback& waitingCallback : callbacks)
+				waitingCallback(path, handle);
+		};
+		requests.push_back(std::move(request));
+	}
+
+	if (!requests.empty())
+		readFilesAsync(requests);
+}
+
+bool FileManager::mountArchive(const char* archiveName)
+{
+	// The one file open for everything inside the archive
+	FileView view;
+	if (!readFromDisk(archiveName, view, MAP_THRESHOLD))
+	{
+		if (logger)
+			OF_LOG(*logger, LOG_LVL_INFO, "Asset archive {} not found, using loose files", archiveName);
+		return false;
+	}
+
+	std::unique_ptr<AssetArchive> archive(new AssetArchive());
+	if (!archive->open(std::move(view), archiveName, logger))
+		return false;
+
+	archives.push_back(std::move(archive));
+
+	return true;
+}
+
+bool FileManager::findInArchives(const char* fileName, FileView& view)
+{
+	if (archives.empty())
+		return false;
+
+	if (!changedFiles.empty() && changedFiles.count(fileName) > 0)
+		return false;
+
+	uint64_t hash = hashArchiveName(fileName, strlen(fileName));
+	for (size_t i = archives.size(); i > 0; i--)
+	{
+		if (archives[i - 1]->find(fileName, hash, view))
+			return true;
+	}
+
+	return false;
+}
+
+void FileManager::readFilesAsync(std::vector<FileRequest>& requests)
+{
+	// Archive entries are already in memory, only loose files go to the background loader
+	std::vector<FileRequest> diskRequests;
+	diskRequests.reserve(requests.size());
+
+	for (FileRequest& request : requests)
+	{
+		FileView view;
+		if (findInArchives(request.path.c_str(), view))
+		{
+			sliceView(view, request.offset, request.size);
+			asyncLoader.submitCompleted(request, std::move(view));
+		}
+		else
+		{
+			diskRequests.push_back(std::move(request));
+		}
+	}
+
+	requests.clear();
+	asyncLoader.submit(diskRequests);
+}
+
+std::future<FileView> FileManager::readFileAsync(const std::string& fileName, uint64_t offset, uint64_t size)
+{
+	FileView view;
+	if (findInArchives(fileName.c_str(), view))
+	{
+		sliceView(view, offset, size);
+
+		std::promise<FileView> promise;
+		promise.set_value(std::move(view));
+		return promise.get_future();
+	}
+
+	return asyncLoader.submit(fileName, offset, size);
+}
+
+void FileManager::sliceView(FileView& view, uint64_t offset, uint64_t size)
+{
+	if (offset == 0 && (size == 0 || size >= view.size))
+		return;
+
+	if (offset > view.size)
+		offset = view.size;
+	if (size == 0 || size > view.size - offset)
+		size = view.size - offset;
+
+	// Borrowed views can just be narrowed, owned ones need a copy of the range
+	if (!view.buffer)
+	{
+		view.data += offset;
+		view.size = (size_t)size;
+		return;
+	}
+
+	FileView slice;
+	char* buffer = slice.allocate((size_t)size);
+	if (buffer)
+		memcpy(buffer, view.data + offset, (size_t)size);
+	view = std::move(slice);
+}
+
+void FileManager::pollCompletions()
 {
-    std::ifstream data;
-    int num;
+	asyncLoader.pollCompletions();
+	watcher.pollChanges();
+}
+
+void FileManager::watchFile(const std::string& fileName, FileChangeCallback callback)
+{
+	watcher.watch(fileName, [this, callback](const std::string& path) {
+		FileView archived;
+		if (findInArchives(path.c_str(), archived) && logger)
+			OF_LOG(*logger, LOG_LVL_INFO, "{} changed on disk, using it instead of the archived copy", path);
+		changedFiles.insert(path);
+
+		cache.invalidate(path);
+		callback(path);
+	});
+}
+
+#ifdef _WIN32
+
+bool FileManager::readFromDisk(const char* fileName, FileView& view, size_t mapThreshold)
+{
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	if ((uint64_t)fileSize.QuadPart >= mapThreshold && fileSize.QuadPart > 0)
+	{
+		// The view keeps the mapping alive, neither handle is needed after this
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (mapping)
+			CloseHandle(mapping);
+
+		if (base)
+		{
+			CloseHandle(file);
+
+			view.data = (const char*)base;
+			view.size = (size_t)fileSize.QuadPart;
+			view.mapped = true;
+
+			return true;
+		}
+
+		// Could not be mapped, read it from the handle that is already open instead
+	}
+
+	// Buffered views are null terminated so text files such as shaders can be used as a C string
+	char* buffer = view.allocate((size_t)fileSize.QuadPart);
+	size_t remaining = buffer ? (size_t)fileSize.QuadPart : 0;
+
+	while (buffer && remaining > 0)
+	{
+		DWORD chunk = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+		DWORD count = 0;
+		if (!ReadFile(file, buffer, chunk, &count, NULL) || count == 0)
+			break;
 
-    data.open(fileName);
-    if (!data)
-    {
-        
-    }
+		buffer += count;
+		remaining -= count;
+	}
 
-    data >> num;
+	CloseHandle(file);
 
-    while (!data.eof())
-    {
-        data >> num;
-    }
+	if (!buffer || remaining > 0)
+	{
+		view.release();
+		return false;
+	}
 
-    data.close();
+	return true;
+}
+
+#else
+
+bool FileManager::readFromDisk(const char* fileName, FileView& view, size_t mapThreshold)
+{
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	size_t fileSize = (size_t)info.st_size;
+
+	if (fileSize >= mapThreshold && fileSize > 0)
+	{
+		// The mapping keeps the file alive, the descriptor is not needed after this
+		void* base = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (base != MAP_FAILED)
+		{
+			close(fd);
+			madvise(base, fileSize, MADV_WILLNEED);
+
+			view.data = (const char*)base;
+			view.size = fileSize;
+			view.mapped = true;
 
-    return nullptr;
+			return true;
+		}
+
+		// Could not be mapped, read it from the descriptor that is already open instead
+	}
+
+	// Buffered views are null terminated so text files such as shaders can be used as a C string
+	char* buffer = view.allocate(fileSize);
+	size_t remaining = buffer ? fileSize : 0;
+
+	while (buffer && remaining > 0)
+	{
+		ssize_t count = read(fd, buffer, remaining);
+		if (count <= 0)
+			break;
+
+		buffer += count;
+		remaining -= (size_t)count;
+	}
+
+	close(fd);
+
+	if (!buffer || remaining > 0)
+	{
+		view.release();
+		return false;
+	}
+
+	return true;
 }
+
+#endif
@@ -6,10 +6,133 @@
 
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "AssetCache.h"
+#include "AsyncFileLoader.h"
+#include "FileWatcher.h"
+#include "Logger.h"
+
+// Read only view of a whole file. Large files are memory mapped so nothing is copied,
+// small ones are read into a buffer owned by the view. Either way the data stays valid
+// until the view is destroyed. Views of uncompressed archive entries borrow the archive's
+// memory instead and are valid as long as the archive stays mounted. Move only.
+class FileView
+{
+public:
+	FileView();
+	~FileView();
+
+	FileView(FileView&& other) noexcept;
+	FileView& operator=(FileView&& other) noexcept;
+
+	FileView(const FileView&) = delete;
+	FileView& operator=(const FileView&) = delete;
+
+	const char* getData() const { return data; }
+	size_t getSize() const { return size; }
+	bool isValid() const { return data != nullptr; }
+	bool isMapped() const { return mapped; }
+
+	explicit operator bool() const { return isValid(); }
+
+	void release();
+
+private:
+	friend class FileManager;
+	friend class AsyncFileLoader;
+	friend class AssetArchive;
+
+	const char* data;
+	size_t size;
+	bool mapped;
+	std::unique_ptr<char[]> buffer;
+
+	// Replaces the contents with an owned, null terminated buffer of size bytes and returns it for filling
+	char* allocate(size_t bufferSize);
+
+	// Points the view at memory owned by someone else
+	void borrow(const char* borrowedData, size_t borrowedSize);
+};
+
+class AssetArchive;
+
+// Runs on whichever thread calls pollCompletions, with an invalid handle if the file could not be read
+typedef std::function<void(const std::string& path, AssetHandle& asset)> AssetCallback;
+
 class FileManager
 {
 public:
-	const char* readFile(const char* fileName);
+	FileManager();
+	~FileManager();
+
+	bool init(Logger* primaryLogger);
+	void cleanup();
+
+	// Returns an invalid view if the file could not be opened. Loose files of at least mapThreshold bytes are
+	// mapped, 0 maps every file and SIZE_MAX reads every file into a buffer
+	FileView readFile(const char* fileName, size_t mapThreshold = MAP_THRESHOLD);
+
+	// Cached read, repeated loads of the same path return the same data without touching the disk.
+	// Returns an invalid handle if the file could not be read
+	AssetHandle loadAsset(const char* fileName);
+	// Only what is in the cache right now, never touches the disk
+	AssetHandle findAsset(const char* fileName) { return cache.find(fileName); }
+	// loadAsset without blocking, files that are not cached are read in the background and added to the cache.
+	// The callback runs once per file, straight away for files that are already cached. A file that is already
+	// being read is not read again, the callback waits for that read. Call it from the thread that polls completions
+	void loadAssetsAsync(const std::vector<std::string>& fileNames, AssetCallback callback);
+	void setCacheBudget(size_t budgetBytes) { cache.setBudget(budgetBytes); }
+	AssetCacheStats getCacheStats() { return cache.getStats(); }
+
+	// Mounted archives are searched (newest first) before loose files on disk
+	bool mountArchive(const char* archiveName);
+
+	// Non blocking reads, callbacks run on whichever thread calls pollCompletions.
+	// Submitting a whole batch at once lets io_uring keep all of them in flight together
+	void readFilesAsync(std::vector<FileRequest>& requests);
+	std::future<FileView> readFileAsync(const std::string& fileName, uint64_t offset = 0, uint64_t size = 0);
+	void pollCompletions();
+
+	// Calls callback from pollCompletions whenever the file is modified on disk, cached copies are dropped first.
+	// From the first change on the loose file is read instead of any archived copy, so edits reach hot reloads
+	void watchFile(const std::string& fileName, FileChangeCallback callback);
+
+	AsyncFileStats getAsyncStats() { return asyncLoader.getStats(); }
+
+	// Files smaller than this are read into a buffer, mapping them costs more than copying
+	static const size_t MAP_THRESHOLD = 64 * 1024;
+
+	// Default size of the asset cache, entries in use can push it over
+	static const size_t CACHE_BUDGET = 256 * 1024 * 1024;
+
+	// Worker threads for the fallback loader and most reads kept in flight by io_uring
+	static const unsigned int ASYNC_THREADS = 4;
+	static const unsigned int ASYNC_QUEUE_DEPTH = 64;
 
 private:
+	// Systems
+	Logger* logger = nullptr;
+
+	AsyncFileLoader asyncLoader;
+	AssetCache cache;
+	FileWatcher watcher;
+	std::vector<std::unique_ptr<AssetArchive>> archives;
+
+	// Loose files changed on disk since they were watched, these skip the archives
+	std::unordered_set<std::string> changedFiles;
+
+	// Callbacks waiting on each file loadAssetsAsync is reading
+	std::unordered_map<std::string, std::vector<AssetCallback>> pendingAssets;
+
+	bool findInArchives(const char* fileName, FileView& view);
+	static void sliceView(FileView& view, uint64_t offset, uint64_t size);
+
+	// Opens and sizes the file once, then maps it if it is at least mapThreshold bytes and reads it into a buffer otherwise
+	bool readFromDisk(const char* fileName, FileView& view, size_t mapThreshold);
 };
\ No newline at end of file
@@ -0,0 +1,253 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* FileWatcher.cpp
+*/
+
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "FileWatcher.h"
+
+FileWatcher::FileWatcher()
+	: logger(nullptr), running(false), inotifyFd(-1), wakeFd(-1)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+	cleanup();
+}
+
+bool FileWatcher::init(Logger* primaryLogger)
+{
+	logger = primaryLogger;
+	running = true;
+
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (inotifyFd >= 0 && wakeFd >= 0)
+	{
+		thread = std::thread(&FileWatcher::inotifyLoop, this);
+		return true;
+	}
+
+	if (inotifyFd >= 0)
+		close(inotifyFd);
+	if (wakeFd >= 0)
+		close(wakeFd);
+	inotifyFd = -1;
+	wakeFd = -1;
+
+	if (logger)
+		OF_LOG(*logger, LOG_LVL_WRN, "inotify is not available, polling watched files instead");
+#endif
+
+	thread = std::thread(&FileWatcher::pollLoop, this);
+
+	return true;
+}
+
+void FileWatcher::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+
+#ifdef __linux__
+	if (wakeFd >= 0)
+	{
+		uint64_t wake = 1;
+		if (write(wakeFd, &wake, sizeof(wake)) != sizeof(wake))
+		{
+			// The thread still notices running is false within one poll timeout
+		}
+	}
+#endif
+
+	if (thread.joinable())
+		thread.join();
+
+#ifdef __linux__
+	if (inotifyFd >= 0)
+		close(inotifyFd);
+	if (wakeFd >= 0)
+		close(wakeFd);
+	inotifyFd = -1;
+	wakeFd = -1;
+#endif
+
+	std::lock_guard<std::mutex> lock(mutex);
+	files.clear();
+	directories.clear();
+}
+
+void FileWatcher::watch(const std::string& path, FileChangeCallback callback)
+{
+	std::filesystem::path filePath(path);
+
+	WatchedFile file;
+	file.path = path;
+	file.directory = filePath.has_parent_path() ? filePath.parent_path().string() : ".";
+	file.name = filePath.filename().string();
+	file.callback = std::move(callback);
+	file.changed = false;
+	file.lastWriteTime = getWriteTime(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+#ifdef __linux__
+	// Watch the directory rather than the file, editors that save by renaming a temporary file
+	// over the original would otherwise leave the watch on a deleted inode
+	if (inotifyFd >= 0)
+	{
+		bool found = false;
+		for (const WatchedDirectory& directory : directories)
+			found |= directory.path == file.directory;
+
+		if (!found)
+		{
+			WatchedDirectory directory;
+			directory.path = file.directory;
+			directory.descriptor = inotify_add_watch(inotifyFd, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+			if (directory.descriptor < 0)
+			{
+				if (logger)
+					OF_LOG(*logger, LOG_LVL_WRN, "Failed to watch directory {}", file.directory);
+			}
+			else
+			{
+				directories.push_back(directory);
+			}
+		}
+	}
+#endif
+
+	files.push_back(std::move(file));
+}
+
+void FileWatcher::pollChanges()
+{
+	std::vector<std::pair<FileChangeCallback, std::string>> settled;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (WatchedFile& file : files)
+		{
+			if (file.changed && now - file.lastEvent >= std::chrono::milliseconds((int64_t)COALESCE_MS))
+			{
+				file.changed = false;
+				settled.emplace_back(file.callback, file.path);
+			}
+		}
+	}
+
+	// Outside the lock so callbacks can watch more files
+	for (std::pair<FileChangeCallback, std::string>& change : settled)
+		change.first(change.second);
+}
+
+void FileWatcher::markChanged(int descriptor, const char* name)
+{
+	// Called with the mutex held
+	const std::string* directory = nullptr;
+	for (const WatchedDirectory& watched : directories)
+	{
+		if (watched.descriptor == descriptor)
+			directory = &watched.path;
+	}
+
+	if (!directory)
+		return;
+
+	for (WatchedFile& file : files)
+	{
+		if (file.directory == *directory && file.name == name)
+		{
+			file.changed = true;
+			file.lastEvent = std::chrono::steady_clock::now();
+		}
+	}
+}
+
+int64_t FileWatcher::getWriteTime(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+	if (error)
+		return 0;
+
+	return (int64_t)time.time_since_epoch().count();
+}
+
+#ifdef __linux__
+
+void FileWatcher::inotifyLoop()
+{
+	alignas(inotify_event) char buffer[16 * 1024];
+
+	for (;;)
+	{
+		pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+		poll(fds, 2, -1);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running)
+			break;
+
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* event = buffer; event < buffer + length;)
+			{
+				inotify_event* info = (inotify_event*)event;
+				if (info->len > 0)
+					markChanged(info->wd, info->name);
+
+				event += sizeof(inotify_event) + info->len;
+			}
+		}
+	}
+}
+
+#else
+
+void FileWatcher::inotifyLoop()
+{
+}
+
+#endif
+
+void FileWatcher::pollLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (running)
+	{
+		for (WatchedFile& file : files)
+		{
+			int64_t writeTime = getWriteTime(file.path);
+			if (writeTime != file.lastWriteTime)
+			{
+				file.lastWriteTime = writeTime;
+				file.changed = true;
+				file.lastEvent = std::chrono::steady_clock::now();
+			}
+		}
+
+		lock.unlock();
+		std::this_thread::sleep_for(std::chrono::milliseconds((int64_t)POLL_INTERVAL_MS));
+		lock.lock();
+	}
+}
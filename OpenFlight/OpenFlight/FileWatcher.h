@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* FileWatcher.h
+*/
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+
+// Called on the main thread from FileManager::pollCompletions once a watched file has stopped changing
+typedef std::function<void(const std::string& path)> FileChangeCallback;
+
+// Watches individual files for changes. On Linux a background thread waits on inotify, everywhere else it
+// polls modification times. Editors usually produce a burst of events per save (truncate, write, rename...),
+// so a file is only reported once it has been quiet for COALESCE_MS and every burst becomes a single callback.
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	bool init(Logger* primaryLogger);
+	void cleanup();
+
+	void watch(const std::string& path, FileChangeCallback callback);
+
+	// Runs the callbacks of every file that changed and has settled, must be called from the main thread
+	void pollChanges();
+
+	static const unsigned int COALESCE_MS = 100;
+	static const unsigned int POLL_INTERVAL_MS = 250;
+
+private:
+	struct WatchedFile
+	{
+		std::string path;
+		std::string directory;
+		std::string name;
+		FileChangeCallback callback;
+
+		bool changed;
+		std::chrono::steady_clock::time_point lastEvent;
+		int64_t lastWriteTime;	// Only used when polling
+	};
+
+	struct WatchedDirectory
+	{
+		std::string path;
+		int descriptor;
+	};
+
+	// Systems
+	Logger* logger;
+
+	bool running;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::vector<WatchedFile> files;
+	std::vector<WatchedDirectory> directories;
+
+	int inotifyFd;
+	int wakeFd;
+
+	void inotifyLoop();
+	void pollLoop();
+	void markChanged(int descriptor, const char* name);
+
+	static int64_t getWriteTime(const std::string& path);
+};
\ No newline at end of file
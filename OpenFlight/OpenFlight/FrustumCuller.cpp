@@ -0,0 +1,273 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* FrustumCuller.cpp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OPENFLIGHT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC emits any intrinsic it is given, GCC and Clang need the kernel marked with the instruction sets it uses
+#if defined(OPENFLIGHT_X86) && defined(__GNUC__)
+#define OPENFLIGHT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define OPENFLIGHT_TARGET_AVX2
+#endif
+
+#include "FrustumCuller.h"
+
+const char* const cullKernelNames[CULL_KERNEL_COUNT] = { "scalar", "SSE", "AVX2" };
+
+// Normalized a, b, c, d with a sphere inside when a * x + b * y + c * z + d >= -radius
+struct FrustumPlanes
+{
+	float planes[6][4];
+};
+
+typedef uint32_t (*CullKernelFunc)(const FrustumPlanes& frustum, const float* x, const float* y, const float* z, const float* r,
+	uint32_t begin, uint32_t end, uint32_t* visible);
+
+static void extractPlanes(const float* m, FrustumPlanes& frustum)
+{
+	// Column major, row i of the matrix is m[i], m[4 + i], m[8 + i], m[12 + i]
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		uint32_t row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+
+		float* plane = frustum.planes[i];
+		for (uint32_t c = 0; c < 4; c++)
+			plane[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+				plane[c] /= length;
+		}
+	}
+}
+
+static uint32_t cullScalar(const FrustumPlanes& frustum, const float* x, const float* y, const float* z, const float* r,
+	uint32_t begin, uint32_t end, uint32_t* visible)
+{
+	uint32_t written = 0;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		bool inside = true;
+		for (const float* plane : frustum.planes)
+			inside &= plane[0] * x[i] + plane[1] * y[i] + plane[2] * z[i] + plane[3] >= -r[i];
+
+		if (inside)
+			visible[written++] = i;
+	}
+
+	return written;
+}
+
+#ifdef OPENFLIGHT_X86
+
+static inline uint32_t lowestBit(uint32_t bits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctz(bits);
+#endif
+}
+
+static uint32_t cullSSE(const FrustumPlanes& frustum, const float* x, const float* y, const float* z, const float* r,
+	uint32_t begin, uint32_t end, uint32_t* visible)
+{
+	uint32_t written = 0;
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(x + i);
+		__m128 cy = _mm_loadu_ps(y + i);
+		__m128 cz = _mm_loadu_ps(z + i);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const float* plane : frustum.planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane[0])), _mm_mul_ps(cy, _mm_set1_ps(plane[1]))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		for (uint32_t bits = (uint32_t)_mm_movemask_ps(inside); bits; bits &= bits - 1)
+			visible[written++] = i + lowestBit(bits);
+	}
+
+	return written + cullScalar(frustum, x, y, z, r, i, end, visible + written);
+}
+
+OPENFLIGHT_TARGET_AVX2 static uint32_t cullAVX2(const FrustumPlanes& frustum, const float* x, const float* y, const float* z, const float* r,
+	uint32_t begin, uint32_t end, uint32_t* visible)
+{
+	// Broadcast once per range instead of once per step
+	__m256 planes[6][4];
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+	}
+
+	uint32_t written = 0;
+	uint32_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(x + i);
+		__m256 cy = _mm256_loadu_ps(y + i);
+		__m256 cz = _mm256_loadu_ps(z + i);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r + i));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const __m256* plane : planes)
+		{
+			__m256 distance = _mm256_fmadd_ps(cx, plane[0], _mm256_fmadd_ps(cy, plane[1], _mm256_fmadd_ps(cz, plane[2], plane[3])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		for (uint32_t bits = (uint32_t)_mm256_movemask_ps(inside); bits; bits &= bits - 1)
+			visible[written++] = i + lowestBit(bits);
+	}
+
+	return written + cullScalar(frustum, x, y, z, r, i, end, visible + written);
+}
+
+#endif
+
+static CullKernelFunc kernelFunc(cullKernel kernel)
+{
+	switch (kernel)
+	{
+#ifdef OPENFLIGHT_X86
+	case CULL_KERNEL_SSE: return cullSSE;
+	case CULL_KERNEL_AVX2: return cullAVX2;
+#endif
+	default: return cullScalar;
+	}
+}
+
+cullKernel FrustumCuller::getBestKernel()
+{
+#ifdef OPENFLIGHT_X86
+#ifdef _MSC_VER
+	// AVX2 and FMA from cpuid, and the OS has to save the YMM registers
+	int info[4];
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+
+	if (fma && osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6)
+		return CULL_KERNEL_AVX2;
+#else
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return CULL_KERNEL_AVX2;
+#endif
+
+	// Part of every x86-64 CPU
+	return CULL_KERNEL_SSE;
+#else
+	return CULL_KERNEL_SCALAR;
+#endif
+}
+
+FrustumCuller::FrustumCuller()
+	: logger(nullptr), jobSystem(nullptr), count(0), kernel(CULL_KERNEL_SCALAR), stats()
+{
+	stats.kernel = cullKernelNames[kernel];
+}
+
+bool FrustumCuller::init(Logger* primaryLogger, JobSystem* primaryJobSystem)
+{
+	logger = primaryLogger;
+	jobSystem = primaryJobSystem;
+
+	kernel = getBestKernel();
+	stats.kernel = cullKernelNames[kernel];
+
+	return true;
+}
+
+void FrustumCuller::cleanup()
+{
+	resize(0);
+	centreX.shrink_to_fit();
+	centreY.shrink_to_fit();
+	centreZ.shrink_to_fit();
+	radii.shrink_to_fit();
+	rangeVisible.clear();
+	rangeVisible.shrink_to_fit();
+}
+
+void FrustumCuller::resize(uint32_t sphereCount)
+{
+	count = sphereCount;
+	centreX.resize(count);
+	centreY.resize(count);
+	centreZ.resize(count);
+	radii.resize(count);
+}
+
+void FrustumCuller::setKernel(cullKernel requested)
+{
+	kernel = std::min(requested, getBestKernel());
+	stats.kernel = cullKernelNames[kernel];
+}
+
+uint32_t FrustumCuller::cull(const float* viewProjection, std::vector<uint32_t>& visible)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	FrustumPlanes frustum;
+	extractPlanes(viewProjection, frustum);
+
+	// Every range writes from its own start, so no two threads ever touch the same part of the output
+	uint32_t rangeCount = (count + CULL_GRAIN - 1) / CULL_GRAIN;
+	rangeVisible.assign(rangeCount, 0);
+	visible.resize(count);
+
+	CullKernelFunc func = kernelFunc(kernel);
+	JobRange job = [&](uint32_t begin, uint32_t end) {
+		rangeVisible[begin / CULL_GRAIN] = func(frustum, centreX.data(), centreY.data(), centreZ.data(), radii.data(), begin, end, visible.data() + begin);
+	};
+
+	if (jobSystem)
+		jobSystem->parallelFor(count, CULL_GRAIN, job);
+	else
+		job(0, count);
+
+	// Close the gaps between the ranges, the first one is already in place
+	uint32_t written = rangeCount > 0 ? rangeVisible[0] : 0;
+	for (uint32_t range = 1; range < rangeCount; range++)
+	{
+		memmove(visible.data() + written, visible.data() + (size_t)range * CULL_GRAIN, rangeVisible[range] * sizeof(uint32_t));
+		written += rangeVisible[range];
+	}
+	visible.resize(written);
+
+	stats.threads = jobSystem ? jobSystem->getThreadCount() : 1;
+	stats.spheres = count;
+	stats.visible = written;
+	stats.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return written;
+}
@@ -0,0 +1,87 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* FrustumCuller.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Logger.h"
+
+// Widest kernel first picked at init, anything newer than the CPU falls back to the next one down
+enum cullKernel
+{
+	CULL_KERNEL_SCALAR,
+	CULL_KERNEL_SSE,		// 4 spheres per step
+	CULL_KERNEL_AVX2,		// 8 spheres per step, with FMA
+	CULL_KERNEL_COUNT,
+};
+
+extern const char* const cullKernelNames[CULL_KERNEL_COUNT];
+
+// Last cull
+struct FrustumCullStats
+{
+	const char* kernel;
+	uint32_t threads;
+	uint32_t spheres;
+	uint32_t visible;
+	double cullMs;
+};
+
+// Culls bounding spheres against the six planes of a view projection matrix on the CPU, for when the GPU culler
+// is not available. Spheres are stored as structure of arrays, one array per centre component and one for the
+// radius, so the SSE and AVX2 kernels load 4 or 8 of them at a time with no shuffling. The spheres are split
+// into ranges of CULL_GRAIN and spread over the job system. Every range writes its visible indices into its own
+// part of the output, which is then packed together in order.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	bool init(Logger* primaryLogger, JobSystem* primaryJobSystem);
+	void cleanup();
+
+	// New spheres are undefined until they are set. Different indices can be set from different threads
+	void resize(uint32_t count);
+	uint32_t getCount() const { return count; }
+	void setSphere(uint32_t index, float x, float y, float z, float radius)
+	{
+		centreX[index] = x;
+		centreY[index] = y;
+		centreZ[index] = z;
+		radii[index] = radius;
+	}
+
+	// Indices of the spheres at least partly inside the frustum, in ascending order
+	uint32_t cull(const float* viewProjection, std::vector<uint32_t>& visible);
+
+	// Clamped to what the CPU supports
+	void setKernel(cullKernel requested);
+	cullKernel getKernel() const { return kernel; }
+	static cullKernel getBestKernel();
+
+	FrustumCullStats getStats() const { return stats; }
+
+	// Spheres per job range, a multiple of 8 so only the last range has a tail for the scalar kernel
+	static const uint32_t CULL_GRAIN = 16 * 1024;
+
+private:
+	// Systems
+	Logger* logger;
+	JobSystem* jobSystem;
+
+	uint32_t count;
+	std::vector<float> centreX;
+	std::vector<float> centreY;
+	std::vector<float> centreZ;
+	std::vector<float> radii;
+
+	std::vector<uint32_t> rangeVisible;
+	cullKernel kernel;
+	FrustumCullStats stats;
+};
\ No newline at end of file
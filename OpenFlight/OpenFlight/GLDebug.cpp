@@ -0,0 +1,168 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GLDebug.cpp
+*/
+
+#include <cstring>
+#include <string>
+
+#include <GLFW/glfw3.h>
+
+#include "GLDebug.h"
+
+// Before 4.3 the same entry points come from GL_KHR_debug, which uses the unsuffixed names in core contexts
+typedef void (APIENTRYP debugMessageCallbackProc)(GLDEBUGPROC callback, const void* userParam);
+typedef void (APIENTRYP debugMessageControlProc)(GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled);
+
+GLenum glCheckError_(Logger* logger, const char* file, int line)
+{
+	GLenum errorCode;
+	while ((errorCode = glGetError()) != GL_NO_ERROR)
+	{
+		const char* error = "UNKNOWN";
+		switch (errorCode)
+		{
+		case GL_INVALID_ENUM:                  error = "INVALID_ENUM"; break;
+		case GL_INVALID_VALUE:                 error = "INVALID_VALUE"; break;
+		case GL_INVALID_OPERATION:             error = "INVALID_OPERATION"; break;
+		case GL_STACK_OVERFLOW:                error = "STACK_OVERFLOW"; break;
+		case GL_STACK_UNDERFLOW:               error = "STACK_UNDERFLOW"; break;
+		case GL_OUT_OF_MEMORY:                 error = "OUT_OF_MEMORY"; break;
+		case GL_INVALID_FRAMEBUFFER_OPERATION: error = "INVALID_FRAMEBUFFER_OPERATION"; break;
+		}
+		OF_LOG(*logger, LOG_LVL_ERR, "GL error {} | {} ({})", error, file, line);
+	}
+	return errorCode;
+}
+
+static const char* debugSourceName(GLenum source)
+{
+	switch (source)
+	{
+	case GL_DEBUG_SOURCE_API: return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+static const char* debugTypeName(GLenum type)
+{
+	switch (type)
+	{
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+{
+	Logger* logger = (Logger*)userParam;
+
+	logLevel lvl;
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH: lvl = LOG_LVL_ERR; break;
+	case GL_DEBUG_SEVERITY_MEDIUM: lvl = LOG_LVL_WRN; break;
+	case GL_DEBUG_SEVERITY_LOW: lvl = LOG_LVL_INFO; break;
+	default: lvl = LOG_LVL_DEBUG; break;
+	}
+
+	// Errors are always reported as high severity by some drivers and not at all by others
+	if (type == GL_DEBUG_TYPE_ERROR)
+		lvl = LOG_LVL_ERR;
+
+	std::string text = length >= 0 ? std::string(message, (size_t)length) : std::string(message);
+	// OF_LOG needs the level at compile time, these go out as text chunks even in binary logs
+	logger->logOut(lvl, "GL {} {} {}: {}", debugSourceName(source), debugTypeName(type), id, text);
+}
+
+static bool hasDebugExtension()
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp((const char*)extension, "GL_KHR_debug") == 0)
+			return true;
+	}
+
+	return false;
+}
+
+GLDebug::GLDebug()
+	: logger(nullptr), mode(DEBUG_OUTPUT_OFF)
+{
+}
+
+bool GLDebug::init(Logger* primaryLogger, debugOutputMode outputMode)
+{
+	logger = primaryLogger;
+	mode = DEBUG_OUTPUT_OFF;
+
+	if (outputMode == DEBUG_OUTPUT_OFF)
+		return true;
+
+	debugMessageCallbackProc debugMessageCallback = nullptr;
+	debugMessageControlProc debugMessageControl = nullptr;
+	if (GLAD_GL_VERSION_4_3)
+	{
+		debugMessageCallback = glDebugMessageCallback;
+		debugMessageControl = glDebugMessageControl;
+	}
+	else if (hasDebugExtension())
+	{
+		debugMessageCallback = (debugMessageCallbackProc)glfwGetProcAddress("glDebugMessageCallback");
+		debugMessageControl = (debugMessageControlProc)glfwGetProcAddress("glDebugMessageControl");
+	}
+
+	if (!debugMessageCallback || !debugMessageControl)
+	{
+		OF_LOG(*logger, LOG_LVL_WRN, "GL_KHR_debug is not supported, GL debug output is disabled");
+		return true;
+	}
+
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+		OF_LOG(*logger, LOG_LVL_INFO, "Not a debug context, the driver may not report anything");
+
+	glEnable(GL_DEBUG_OUTPUT);
+	if (outputMode == DEBUG_OUTPUT_SYNC)
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	else
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+	// Notifications are mostly buffer placement chatter, not worth the cost of formatting them
+	debugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+	debugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+	debugMessageCallback(debugMessage, logger);
+
+	mode = outputMode;
+	OF_LOG(*logger, LOG_LVL_INFO, "GL debug output enabled ({})", mode == DEBUG_OUTPUT_SYNC ? "synchronous" : "asynchronous");
+
+	return true;
+}
+
+void GLDebug::cleanup()
+{
+	if (mode == DEBUG_OUTPUT_OFF)
+		return;
+
+	// The logger is cleaned up after this, the driver must not call back into it
+	debugMessageCallbackProc debugMessageCallback = GLAD_GL_VERSION_4_3 ? glDebugMessageCallback :
+		(debugMessageCallbackProc)glfwGetProcAddress("glDebugMessageCallback");
+	debugMessageCallback(NULL, NULL);
+	glDisable(GL_DEBUG_OUTPUT);
+
+	mode = DEBUG_OUTPUT_OFF;
+}
@@ -0,0 +1,56 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GLDebug.h
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Logger.h"
+
+// glGetError after every call makes the driver finish everything queued before it, so the checks are compiled
+// out of Release builds. Define OPENFLIGHT_GL_CHECKS as 0 or 1 to override
+#ifndef OPENFLIGHT_GL_CHECKS
+#ifdef NDEBUG
+#define OPENFLIGHT_GL_CHECKS 0
+#else
+#define OPENFLIGHT_GL_CHECKS 1
+#endif
+#endif
+
+// Logs every pending GL error through the logger in scope, e.g. a class's logger member
+#if OPENFLIGHT_GL_CHECKS
+#define glCheckError() glCheckError_(logger, __FILE__, __LINE__)
+#else
+#define glCheckError() ((void)0)
+#endif
+
+GLenum glCheckError_(Logger* logger, const char* file, int line);
+
+enum debugOutputMode
+{
+	DEBUG_OUTPUT_OFF,
+	DEBUG_OUTPUT_ASYNC,		// The driver reports whenever it likes, possibly from its own threads
+	DEBUG_OUTPUT_SYNC,		// Reported inside the call that caused it, slower but a debugger breakpoint shows the culprit
+};
+
+// Routes GL_KHR_debug messages through the logger, so errors are reported by the driver as they happen instead
+// of being polled for. Needs a context created with GLFW_OPENGL_DEBUG_CONTEXT on most drivers
+class GLDebug
+{
+public:
+	GLDebug();
+
+	bool init(Logger* primaryLogger, debugOutputMode outputMode);
+	void cleanup();
+
+	debugOutputMode getMode() const { return mode; }
+
+private:
+	// Systems
+	Logger* logger;
+
+	debugOutputMode mode;
+};
\ No newline at end of file
@@ -0,0 +1,282 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GLStateCache.cpp
+*/
+
+#include <cstring>
+
+#include "GLStateCache.h"
+
+// Index into the tracked bindings, -1 for targets that are always issued
+static int bufferTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_ELEMENT_ARRAY_BUFFER: return 1;
+	case GL_UNIFORM_BUFFER: return 2;
+	case GL_DRAW_INDIRECT_BUFFER: return 3;
+	case GL_SHADER_STORAGE_BUFFER: return 4;
+	case GL_COPY_READ_BUFFER: return 5;
+	case GL_COPY_WRITE_BUFFER: return 6;
+	case GL_PIXEL_UNPACK_BUFFER: return 7;
+	default: return -1;
+	}
+}
+
+static int textureTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_2D_ARRAY: return 1;
+	case GL_TEXTURE_CUBE_MAP: return 2;
+	case GL_TEXTURE_3D: return 3;
+	default: return -1;
+	}
+}
+
+static int capabilityIndex(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_BLEND: return 0;
+	case GL_DEPTH_TEST: return 1;
+	case GL_CULL_FACE: return 2;
+	case GL_SCISSOR_TEST: return 3;
+	case GL_STENCIL_TEST: return 4;
+	default: return -1;
+	}
+}
+
+GLStateCache::GLStateCache()
+	: logger(nullptr), stats(), frameIssued(0), frameElided(0)
+{
+	invalidate();
+}
+
+bool GLStateCache::init(Logger* primaryLogger)
+{
+	logger = primaryLogger;
+
+	invalidate();
+
+	return true;
+}
+
+void GLStateCache::cleanup()
+{
+	OF_LOG(*logger, LOG_LVL_INFO, "GL state changes: {} issued, {} elided", stats.totalIssued, stats.totalElided);
+}
+
+void GLStateCache::invalidate()
+{
+	program = GL_STATE_UNKNOWN;
+	vertexArray = GL_STATE_UNKNOWN;
+	activeTexture = GL_STATE_UNKNOWN;
+
+	for (GLuint& buffer : buffers)
+		buffer = GL_STATE_UNKNOWN;
+
+	for (auto& unit : textures)
+	{
+		for (GLuint& texture : unit)
+			texture = GL_STATE_UNKNOWN;
+	}
+
+	for (int8_t& capability : capabilities)
+		capability = -1;
+
+	blendSource = GL_STATE_UNKNOWN;
+	blendDestination = GL_STATE_UNKNOWN;
+	depthFunc = GL_STATE_UNKNOWN;
+	depthMask = -1;
+	clearColorKnown = false;
+}
+
+void GLStateCache::endFrame()
+{
+	stats.frameIssued = frameIssued;
+	stats.frameElided = frameElided;
+	stats.totalIssued += frameIssued;
+	stats.totalElided += frameElided;
+
+	frameIssued = 0;
+	frameElided = 0;
+}
+
+void GLStateCache::useProgram(GLuint newProgram)
+{
+	if (newProgram == program ? elide() : issue())
+	{
+		glUseProgram(newProgram);
+		program = newProgram;
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint newVertexArray)
+{
+	if (newVertexArray == vertexArray ? elide() : issue())
+	{
+		glBindVertexArray(newVertexArray);
+		vertexArray = newVertexArray;
+
+		// The element buffer binding belongs to the VAO
+		buffers[bufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+	}
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = bufferTargetIndex(target);
+	if (index < 0)
+	{
+		issue();
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (buffer == buffers[index] ? elide() : issue())
+	{
+		glBindBuffer(target, buffer);
+		buffers[index] = buffer;
+	}
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	issue();
+	glBindBufferRange(target, index, buffer, offset, size);
+
+	int targetIndex = bufferTargetIndex(target);
+	if (targetIndex >= 0)
+		buffers[targetIndex] = buffer;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int index = textureTargetIndex(target);
+	bool tracked = index >= 0 && unit < GL_STATE_TEXTURE_UNITS;
+	if (tracked && textures[unit][index] == texture)
+	{
+		elide();
+		return;
+	}
+
+	if (unit == activeTexture ? elide() : issue())
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeTexture = unit;
+	}
+
+	issue();
+	glBindTexture(target, texture);
+	if (tracked)
+		textures[unit][index] = texture;
+}
+
+void GLStateCache::enable(GLenum capability)
+{
+	setCapability(capability, true);
+}
+
+void GLStateCache::disable(GLenum capability)
+{
+	setCapability(capability, false);
+}
+
+void GLStateCache::setCapability(GLenum capability, bool enabled)
+{
+	int index = capabilityIndex(capability);
+	if (index >= 0 && capabilities[index] == (int8_t)enabled)
+	{
+		elide();
+		return;
+	}
+
+	issue();
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+
+	if (index >= 0)
+		capabilities[index] = (int8_t)enabled;
+}
+
+void GLStateCache::setBlendFunc(GLenum source, GLenum destination)
+{
+	if (source == blendSource && destination == blendDestination ? elide() : issue())
+	{
+		glBlendFunc(source, destination);
+		blendSource = source;
+		blendDestination = destination;
+	}
+}
+
+void GLStateCache::setDepthFunc(GLenum func)
+{
+	if (func == depthFunc ? elide() : issue())
+	{
+		glDepthFunc(func);
+		depthFunc = func;
+	}
+}
+
+void GLStateCache::setDepthMask(bool write)
+{
+	if (depthMask == (int8_t)write ? elide() : issue())
+	{
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		depthMask = (int8_t)write;
+	}
+}
+
+void GLStateCache::setClearColor(float r, float g, float b, float a)
+{
+	float color[4] = { r, g, b, a };
+	if (clearColorKnown && memcmp(color, clearColor, sizeof(color)) == 0 ? elide() : issue())
+	{
+		glClearColor(r, g, b, a);
+		memcpy(clearColor, color, sizeof(color));
+		clearColorKnown = true;
+	}
+}
+
+void GLStateCache::deleteBuffer(GLuint buffer)
+{
+	// Deleting a bound buffer unbinds it, and the driver is free to hand the name out again
+	for (GLuint& bound : buffers)
+	{
+		if (bound == buffer)
+			bound = 0;
+	}
+
+	glDeleteBuffers(1, &buffer);
+}
+
+void GLStateCache::deleteVertexArray(GLuint deletedVertexArray)
+{
+	if (vertexArray == deletedVertexArray)
+	{
+		vertexArray = 0;
+		buffers[bufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+	}
+
+	glDeleteVertexArrays(1, &deletedVertexArray);
+}
+
+void GLStateCache::deleteTexture(GLuint texture)
+{
+	for (auto& unit : textures)
+	{
+		for (GLuint& bound : unit)
+		{
+			if (bound == texture)
+				bound = 0;
+		}
+	}
+
+	glDeleteTextures(1, &texture);
+}
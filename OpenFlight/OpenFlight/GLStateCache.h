@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GLStateCache.h
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include "Logger.h"
+
+// Marks state the cache knows nothing about, the next change to it is always issued
+const GLuint GL_STATE_UNKNOWN = 0xFFFFFFFF;
+
+const uint32_t GL_STATE_BUFFER_TARGETS = 8;
+const uint32_t GL_STATE_TEXTURE_TARGETS = 4;
+const uint32_t GL_STATE_TEXTURE_UNITS = 32;
+const uint32_t GL_STATE_CAPABILITIES = 5;
+
+// State changes of the last finished frame, and of everything since init
+struct GLStateStats
+{
+	uint32_t frameIssued;
+	uint32_t frameElided;
+	uint64_t totalIssued;
+	uint64_t totalElided;
+};
+
+// Shadow copy of the GL state the renderer changes. Every change goes through here and only reaches the driver
+// when it differs from what is already set, so drawing many objects with the same program, VAO or textures
+// costs no binds after the first. Anything that changes this state behind the cache's back has to call
+// invalidate afterwards. Objects must be deleted through the cache too, their names get reused by the driver.
+class GLStateCache
+{
+public:
+	GLStateCache();
+
+	bool init(Logger* primaryLogger);
+	void cleanup();
+
+	// Forget everything, the next change to any state is issued
+	void invalidate();
+
+	// Call once per frame after the swap, moves the frame counters into the stats
+	void endFrame();
+
+	GLStateStats getStats() const { return stats; }
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+	void bindBuffer(GLenum target, GLuint buffer);
+	// Indexed bindings are not shadowed, but they also change the target's generic binding
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	void enable(GLenum capability);
+	void disable(GLenum capability);
+	void setBlendFunc(GLenum source, GLenum destination);
+	void setDepthFunc(GLenum func);
+	void setDepthMask(bool write);
+	void setClearColor(float r, float g, float b, float a);
+
+	void deleteBuffer(GLuint buffer);
+	void deleteVertexArray(GLuint vertexArray);
+	void deleteTexture(GLuint texture);
+
+	GLuint getProgram() const { return program; }
+	GLuint getVertexArray() const { return vertexArray; }
+
+private:
+	// Systems
+	Logger* logger;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint buffers[GL_STATE_BUFFER_TARGETS];
+	GLuint activeTexture;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+
+	// 1 enabled, 0 disabled, -1 unknown
+	int8_t capabilities[GL_STATE_CAPABILITIES];
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLenum depthFunc;
+	int8_t depthMask;
+	float clearColor[4];
+	bool clearColorKnown;
+
+	GLStateStats stats;
+	uint32_t frameIssued;
+	uint32_t frameElided;
+
+	// Both count and return whether the call has to be made
+	bool issue() { frameIssued++; return true; }
+	bool elide() { frameElided++; return false; }
+
+	void setCapability(GLenum capability, bool enabled);
+};
\ No newline at end of file
@@ -0,0 +1,311 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GpuCuller.cpp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "GpuCuller.h"
+#include "GLDebug.h"
+
+// Texture unit the pyramid passes sample from
+const GLuint CULL_TEXTURE_UNIT = 0;
+
+// Same binding numbers as cullInstances.comp
+enum cullBinding
+{
+	CULL_BINDING_INSTANCES,
+	CULL_BINDING_INSTANCE_DRAWS,
+	CULL_BINDING_DRAW_BOUNDS,
+	CULL_BINDING_COMMANDS,
+	CULL_BINDING_VISIBLE,
+	CULL_BINDING_COUNTERS,
+};
+
+GpuCuller::GpuCuller()
+	: logger(nullptr), shaderManager(nullptr), stateCache(nullptr), supported(false), enabled(true), occlusion(true), storageAlignment(256),
+	cullShader(INVALID_SHADER), pyramidShader(INVALID_SHADER), inputBuffer(0), inputSize(0), commandBuffer(0), commandSize(0),
+	visibleBuffer(0), visibleSize(0), counterBuffers(), counterFences(), counterInstances(), frame(0), depthCopy(0), pyramid(0),
+	pyramidWidth(0), pyramidHeight(0), pyramidLevels(0), pyramidValid(false), culledFrame(false), viewProjection(), pyramidViewProjection(), stats()
+{
+}
+
+bool GpuCuller::init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache)
+{
+	logger = primaryLogger;
+	shaderManager = primaryShaderManager;
+	stateCache = primaryStateCache;
+
+	// Compute shaders and storage buffers, without them every instance is drawn
+	supported = GLAD_GL_VERSION_4_3 != 0;
+	if (!supported)
+	{
+		OF_LOG(*logger, LOG_LVL_INFO, "Compute shaders are not supported, GPU culling is disabled");
+		return true;
+	}
+
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+	cullShader = shaderManager->loadComputeProgram("cullInstances.comp");
+	pyramidShader = shaderManager->loadComputeProgram("depthPyramid.comp");
+
+	glGenBuffers(FRAMES, counterBuffers);
+	for (GLuint buffer : counterBuffers)
+	{
+		stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(uint32_t), nullptr, GL_DYNAMIC_READ);
+	}
+	glCheckError();
+
+	return true;
+}
+
+void GpuCuller::cleanup()
+{
+	for (uint32_t i = 0; i < FRAMES; i++)
+	{
+		if (counterFences[i])
+			glDeleteSync(counterFences[i]);
+		counterFences[i] = 0;
+
+		if (counterBuffers[i])
+			stateCache->deleteBuffer(counterBuffers[i]);
+		counterBuffers[i] = 0;
+	}
+
+	if (inputBuffer)
+		stateCache->deleteBuffer(inputBuffer);
+	if (commandBuffer)
+		stateCache->deleteBuffer(commandBuffer);
+	if (visibleBuffer)
+		stateCache->deleteBuffer(visibleBuffer);
+	if (depthCopy)
+		stateCache->deleteTexture(depthCopy);
+	if (pyramid)
+		stateCache->deleteTexture(pyramid);
+
+	inputBuffer = commandBuffer = visibleBuffer = 0;
+	inputSize = commandSize = visibleSize = 0;
+	depthCopy = pyramid = 0;
+	pyramidValid = false;
+}
+
+void GpuCuller::setEnabled(bool cullEnabled, bool occlusionEnabled)
+{
+	enabled = cullEnabled;
+	occlusion = occlusionEnabled;
+}
+
+bool GpuCuller::isReady() const
+{
+	return supported && enabled && shaderManager->getProgram(cullShader) != 0;
+}
+
+size_t GpuCuller::align(size_t offset) const
+{
+	size_t alignment = (size_t)std::max(storageAlignment, 1);
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+void GpuCuller::readCounters(uint32_t index)
+{
+	if (!counterFences[index])
+		return;
+
+	// Issued FRAMES frames ago, this practically never waits
+	glClientWaitSync(counterFences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	glDeleteSync(counterFences[index]);
+	counterFences[index] = 0;
+
+	uint32_t counters[3];
+	stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffers[index]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+
+	stats.instances = counterInstances[index];
+	stats.visible = counters[0];
+	stats.frustumCulled = counters[1];
+	stats.occlusionCulled = counters[2];
+}
+
+void GpuCuller::cull(const float* frameViewProjection, const std::vector<InstanceData>& instances, const std::vector<uint32_t>& instanceDraws,
+	const std::vector<float>& drawBounds, const std::vector<DrawElementsIndirectCommand>& commands)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	memcpy(viewProjection, frameViewProjection, sizeof(viewProjection));
+	culledFrame = true;
+
+	uint32_t counterIndex = frame % FRAMES;
+	readCounters(counterIndex);
+	frame++;
+
+	// Inputs in one buffer, each section aligned for glBindBufferRange
+	size_t instanceBytes = instances.size() * sizeof(InstanceData);
+	size_t drawsOffset = align(instanceBytes);
+	size_t drawsBytes = instanceDraws.size() * sizeof(uint32_t);
+	size_t boundsOffset = align(drawsOffset + drawsBytes);
+	size_t boundsBytes = drawBounds.size() * sizeof(float);
+	size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+
+	if (!inputBuffer)
+	{
+		glGenBuffers(1, &inputBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &visibleBuffer);
+	}
+
+	// Every buffer is orphaned, last frame's draws may still be reading them
+	stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, inputBuffer);
+	inputSize = std::max(inputSize, boundsOffset + boundsBytes);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, inputSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceBytes, instances.data());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, drawsOffset, drawsBytes, instanceDraws.data());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, boundsOffset, boundsBytes, drawBounds.data());
+
+	stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	commandSize = std::max(commandSize, commandBytes);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commandSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commandBytes, commands.data());
+
+	stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+	visibleSize = std::max(visibleSize, instanceBytes);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, visibleSize, nullptr, GL_STREAM_DRAW);
+
+	static const uint32_t zero[3] = { 0, 0, 0 };
+	stateCache->bindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffers[counterIndex]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+	counterInstances[counterIndex] = (uint32_t)instances.size();
+
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_INSTANCES, inputBuffer, 0, (GLsizeiptr)instanceBytes);
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_INSTANCE_DRAWS, inputBuffer, (GLintptr)drawsOffset, (GLsizeiptr)drawsBytes);
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_DRAW_BOUNDS, inputBuffer, (GLintptr)boundsOffset, (GLsizeiptr)boundsBytes);
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_COMMANDS, commandBuffer, 0, (GLsizeiptr)commandBytes);
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_VISIBLE, visibleBuffer, 0, (GLsizeiptr)instanceBytes);
+	stateCache->bindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_COUNTERS, counterBuffers[counterIndex], 0, sizeof(zero));
+
+	bool testOcclusion = occlusion && pyramidValid;
+	stats.occlusion = testOcclusion;
+
+	stateCache->useProgram(shaderManager->getProgram(cullShader));
+	shaderManager->setUniform(cullShader, uniformName("instanceCount"), (int)instances.size());
+	shaderManager->setUniformMatrix4(cullShader, uniformName("viewProjection"), viewProjection);
+	shaderManager->setUniform(cullShader, uniformName("occlusion"), testOcclusion ? 1 : 0);
+
+	if (testOcclusion)
+	{
+		stateCache->bindTexture(CULL_TEXTURE_UNIT, GL_TEXTURE_2D, pyramid);
+		shaderManager->setUniformMatrix4(cullShader, uniformName("pyramidViewProjection"), pyramidViewProjection);
+		shaderManager->setUniform(cullShader, uniformName("depthPyramid"), (int)CULL_TEXTURE_UNIT);
+		shaderManager->setUniform(cullShader, uniformName("pyramidSize"), (float)pyramidWidth, (float)pyramidHeight);
+		shaderManager->setUniform(cullShader, uniformName("pyramidLevels"), (int)pyramidLevels);
+	}
+
+	glDispatchCompute((GLuint)((instances.size() + 63) / 64), 1, 1);
+
+	// The draws read the commands and the compacted instances as vertex attributes, readCounters copies the counters back
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	counterFences[counterIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glCheckError();
+
+	stats.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GpuCuller::resizePyramid(GLint width, GLint height)
+{
+	if (depthCopy)
+		stateCache->deleteTexture(depthCopy);
+	if (pyramid)
+		stateCache->deleteTexture(pyramid);
+
+	pyramidWidth = width;
+	pyramidHeight = height;
+	pyramidLevels = 1;
+	while ((std::max(width, height) >> pyramidLevels) > 0)
+		pyramidLevels++;
+
+	// Immutable storage, so every level exists and texelFetch can read any of them
+	glGenTextures(1, &depthCopy);
+	stateCache->bindTexture(CULL_TEXTURE_UNIT, GL_TEXTURE_2D, depthCopy);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &pyramid);
+	stateCache->bindTexture(CULL_TEXTURE_UNIT, GL_TEXTURE_2D, pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glCheckError();
+
+	pyramidValid = false;
+}
+
+void GpuCuller::buildDepthPyramid()
+{
+	bool culled = culledFrame;
+	culledFrame = false;
+
+	if (!isReady() || !occlusion || !shaderManager->getProgram(pyramidShader))
+	{
+		pyramidValid = false;
+		return;
+	}
+
+	// Keeps the last pyramid, it is still from the last view culled with
+	if (!culled)
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Multisampled depth cannot be copied, and targets without depth have nothing to cull against
+	GLint readFramebuffer = 0;
+	GLint depthType = GL_NONE;
+	GLint sampleBuffers = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, readFramebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH,
+		GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &depthType);
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (depthType == GL_NONE || sampleBuffers > 0 || viewport[2] <= 0 || viewport[3] <= 0)
+	{
+		pyramidValid = false;
+		return;
+	}
+
+	if (viewport[2] != pyramidWidth || viewport[3] != pyramidHeight)
+		resizePyramid(viewport[2], viewport[3]);
+
+	// Depth textures copy straight from the read framebuffer's depth buffer
+	stateCache->bindTexture(CULL_TEXTURE_UNIT, GL_TEXTURE_2D, depthCopy);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], pyramidWidth, pyramidHeight);
+
+	stateCache->useProgram(shaderManager->getProgram(pyramidShader));
+	shaderManager->setUniform(pyramidShader, uniformName("source"), (int)CULL_TEXTURE_UNIT);
+
+	for (GLint level = 0; level < pyramidLevels; level++)
+	{
+		GLint width = std::max(pyramidWidth >> level, 1);
+		GLint height = std::max(pyramidHeight >> level, 1);
+
+		// Level 0 from the depth copy, every other one from the level above it
+		shaderManager->setUniform(pyramidShader, uniformName("copyLevel"), level == 0 ? 1 : 0);
+		shaderManager->setUniform(pyramidShader, uniformName("sourceLevel"), std::max(level - 1, 0));
+		if (level == 1)
+			stateCache->bindTexture(CULL_TEXTURE_UNIT, GL_TEXTURE_2D, pyramid);
+
+		glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((GLuint)(width + 7) / 8, (GLuint)(height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glCheckError();
+
+	memcpy(pyramidViewProjection, viewProjection, sizeof(pyramidViewProjection));
+	pyramidValid = true;
+
+	stats.pyramidMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,113 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* GpuCuller.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "IndirectRenderer.h"
+#include "Logger.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+
+// Counted on the GPU and read back FRAMES frames later, so reading them never stalls
+struct CullStats
+{
+	bool occlusion;				// A depth pyramid was available to test against
+	uint32_t instances;
+	uint32_t visible;
+	uint32_t frustumCulled;
+	uint32_t occlusionCulled;
+	double cullMs;				// Main thread time uploading and dispatching the cull
+	double pyramidMs;			// Main thread time copying depth and dispatching the pyramid levels
+};
+
+// Culls the indirect renderer's instances in a compute pass. Every instance's bounding sphere (its mesh's bounds
+// moved by the instance transform) is tested against the frustum and then against a depth pyramid of the
+// previous frame, where each texel holds the farthest depth below it. Visible instances are compacted into
+// their command's range and the command's instanceCount is counted up on the GPU, so the command buffer
+// goes straight to glMultiDrawElementsIndirect without a round trip. Needs GL 4.3 for compute shaders.
+// The pyramid lags a frame behind, objects that were hidden and come into view appear a frame late.
+class GpuCuller
+{
+public:
+	GpuCuller();
+
+	bool init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache);
+	void cleanup();
+
+	// Culling is on by default wherever it is supported, occlusion can be turned off on its own
+	void setEnabled(bool cullEnabled, bool occlusionEnabled);
+	bool isSupported() const { return supported; }
+
+	// True when cull will run this frame, the shaders build in the background like any other
+	bool isReady() const;
+
+	// Uploads the instances and commands, with instanceCount counted from 0, and dispatches the cull.
+	// instanceDraws holds the command of every instance, drawBounds the model space sphere of every command.
+	// Afterwards the command and visible instance buffers are ready to draw from
+	void cull(const float* viewProjection, const std::vector<InstanceData>& instances, const std::vector<uint32_t>& instanceDraws,
+		const std::vector<float>& drawBounds, const std::vector<DrawElementsIndirectCommand>& commands);
+
+	GLuint getCommandBuffer() const { return commandBuffer; }
+	GLuint getVisibleBuffer() const { return visibleBuffer; }
+
+	// Builds the depth pyramid for the next frame from the current depth buffer, call once everything is drawn.
+	// Does nothing on frames without a cull
+	void buildDepthPyramid();
+
+	CullStats getStats() const { return stats; }
+
+	// Counter buffers in flight
+	static const uint32_t FRAMES = 3;
+
+private:
+	// Systems
+	Logger* logger;
+	ShaderManager* shaderManager;
+	GLStateCache* stateCache;
+
+	bool supported;
+	bool enabled;
+	bool occlusion;
+	GLint storageAlignment;
+
+	ShaderHandle cullShader;
+	ShaderHandle pyramidShader;
+
+	// Instances, their commands and the command bounds one after the other, then the compacted output
+	GLuint inputBuffer;
+	size_t inputSize;
+	GLuint commandBuffer;
+	size_t commandSize;
+	GLuint visibleBuffer;
+	size_t visibleSize;
+
+	GLuint counterBuffers[FRAMES];
+	GLsync counterFences[FRAMES];
+	uint32_t counterInstances[FRAMES];
+	uint32_t frame;
+
+	GLuint depthCopy;
+	GLuint pyramid;
+	GLint pyramidWidth;
+	GLint pyramidHeight;
+	GLint pyramidLevels;
+	bool pyramidValid;
+	bool culledFrame;					// Only frames that were culled build a pyramid
+	float viewProjection[16];
+	float pyramidViewProjection[16];	// Where the pyramid was rendered from
+
+	CullStats stats;
+
+	void resizePyramid(GLint width, GLint height);
+	void readCounters(uint32_t index);
+	size_t align(size_t offset) const;
+};
\ No newline at end of file
@@ -0,0 +1,308 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* IndirectRenderer.cpp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+
+#include "IndirectRenderer.h"
+#include "GLDebug.h"
+#include "GpuCuller.h"
+
+static bool hasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp((const char*)extension, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+IndirectRenderer::IndirectRenderer()
+	: logger(nullptr), shaderManager(nullptr), stateCache(nullptr), meshes(nullptr), gpuCuller(nullptr), frustumCuller(nullptr), jobSystem(nullptr), multiDraw(nullptr), buffer(0), bufferSize(0),
+	viewProjection{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }, stats()
+{
+}
+
+bool IndirectRenderer::init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache, MeshManager* primaryMeshes,
+	GpuCuller* primaryGpuCuller, FrustumCuller* primaryFrustumCuller, JobSystem* primaryJobSystem)
+{
+	logger = primaryLogger;
+	shaderManager = primaryShaderManager;
+	stateCache = primaryStateCache;
+	meshes = primaryMeshes;
+	gpuCuller = primaryGpuCuller;
+	frustumCuller = primaryFrustumCuller;
+	jobSystem = primaryJobSystem;
+
+	// baseInstance has to be honoured too, before ARB_base_instance it must be 0
+	if (GLAD_GL_VERSION_4_3)
+		multiDraw = glMultiDrawElementsIndirect;
+	else if (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance"))
+		multiDraw = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+
+	stats.multiDraw = multiDraw != nullptr;
+	if (!multiDraw)
+		OF_LOG(*logger, LOG_LVL_INFO, "Multi draw indirect is not supported, indirect draws are issued one at a time");
+
+	return true;
+}
+
+void IndirectRenderer::cleanup()
+{
+	if (buffer)
+		stateCache->deleteBuffer(buffer);
+	buffer = 0;
+	bufferSize = 0;
+
+	draws.clear();
+	instances.clear();
+	commands.clear();
+	instanceDraws.clear();
+	drawBounds.clear();
+	visibleInstances.clear();
+	culledInstances.clear();
+}
+
+void IndirectRenderer::setViewProjection(const float* matrix)
+{
+	memcpy(viewProjection, matrix, sizeof(viewProjection));
+}
+
+void IndirectRenderer::add(ShaderHandle shader, MeshHandle mesh, const InstanceData* meshInstances, uint32_t count)
+{
+	MeshDraw meshDraw;
+	if (count == 0 || !meshes->getDraw(mesh, meshDraw))
+		return;
+
+	IndirectDraw draw;
+	draw.shader = shader;
+	draw.vertexArray = meshDraw.vertexArray;
+	draw.command.count = meshDraw.indexCount;
+	draw.command.instanceCount = count;
+	draw.command.firstIndex = meshDraw.firstIndex;
+	draw.command.baseVertex = meshDraw.baseVertex;
+	draw.command.baseInstance = (GLuint)instances.size();
+	memcpy(draw.bounds, meshDraw.bounds, sizeof(draw.bounds));
+	draws.push_back(draw);
+
+	instances.insert(instances.end(), meshInstances, meshInstances + count);
+}
+
+void IndirectRenderer::bindInstances(GLuint instanceBuffer, GLintptr offset)
+{
+	stateCache->bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	for (GLuint i = 0; i < 5; i++)
+	{
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + i);
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(offset + i * 4 * sizeof(float)));
+		glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 1);
+	}
+}
+
+void IndirectRenderer::execute()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	stats = IndirectStats();
+	stats.multiDraw = multiDraw != nullptr;
+	stats.culled = multiDraw && gpuCuller && gpuCuller->isReady();
+	stats.cpuCulled = !stats.culled && frustumCuller;
+
+	if (draws.empty())
+		return;
+
+	// Everything that can share one multi draw call ends up next to each other, the order inside a group stays.
+	// Draws usually arrive grouped already, which only costs the check
+	auto groupOrder = [](const IndirectDraw& a, const IndirectDraw& b) {
+		return a.shader != b.shader ? a.shader < b.shader : a.vertexArray < b.vertexArray;
+	};
+	if (!std::is_sorted(draws.begin(), draws.end(), groupOrder))
+		std::stable_sort(draws.begin(), draws.end(), groupOrder);
+
+	commands.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); i++)
+		commands[i] = draws[i].command;
+
+	stats.instances = (uint32_t)instances.size();
+	if (stats.cpuCulled)
+		cullOnCpu();
+	stats.visible = (uint32_t)instances.size();
+
+	// The culler uploads everything itself and leaves the commands and visible instances in its own buffers
+	GLuint instanceBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLintptr instanceOffset = 0;
+	GLintptr commandOffset = 0;
+
+	if (stats.culled)
+	{
+		cullOnGpu();
+		instanceBuffer = gpuCuller->getVisibleBuffer();
+		commandBuffer = gpuCuller->getCommandBuffer();
+	}
+	else
+	{
+		// The command buffer is only read by glMultiDrawElementsIndirect, the fallback loop uses the CPU copy
+		size_t instanceBytes = instances.size() * sizeof(InstanceData);
+		size_t commandBytes = multiDraw ? commands.size() * sizeof(DrawElementsIndirectCommand) : 0;
+		size_t size = instanceBytes + commandBytes;
+		commandOffset = (GLintptr)instanceBytes;
+
+		if (!buffer)
+			glGenBuffers(1, &buffer);
+		instanceBuffer = commandBuffer = buffer;
+
+		stateCache->bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		// Orphans last frame's storage in case the GPU is still reading it
+		bufferSize = std::max(bufferSize, size);
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, instanceOffset, instanceBytes, instances.data());
+		if (commandBytes)
+			glBufferSubData(GL_ARRAY_BUFFER, commandOffset, commandBytes, commands.data());
+	}
+
+	// Opaque, same as the render queue's default material
+	stateCache->disable(GL_BLEND);
+	stateCache->setDepthMask(true);
+
+	size_t groupStart = 0;
+	while (groupStart < draws.size())
+	{
+		size_t groupEnd = groupStart + 1;
+		while (groupEnd < draws.size() && draws[groupEnd].shader == draws[groupStart].shader && draws[groupEnd].vertexArray == draws[groupStart].vertexArray)
+			groupEnd++;
+
+		const IndirectDraw& first = draws[groupStart];
+		GLuint program = shaderManager->getProgram(first.shader);
+		if (program)
+		{
+			stateCache->useProgram(program);
+			stateCache->bindVertexArray(first.vertexArray);
+			shaderManager->setUniformMatrix4(first.shader, uniformName("model"), viewProjection);
+
+			if (multiDraw)
+			{
+				bindInstances(instanceBuffer, instanceOffset);
+				stateCache->bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+				multiDraw(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(commandOffset + groupStart * sizeof(DrawElementsIndirectCommand)), (GLsizei)(groupEnd - groupStart), 0);
+				stats.drawCalls++;
+			}
+			else
+			{
+				// Without base instance support the instance attributes are moved to each command's instances instead
+				for (size_t i = groupStart; i < groupEnd; i++)
+				{
+					const DrawElementsIndirectCommand& command = commands[i];
+					bindInstances(instanceBuffer, instanceOffset + (GLintptr)command.baseInstance * sizeof(InstanceData));
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, GL_UNSIGNED_INT,
+						(const void*)((size_t)command.firstIndex * sizeof(uint32_t)), (GLsizei)command.instanceCount, command.baseVertex);
+					stats.drawCalls++;
+				}
+			}
+			glCheckError();
+		}
+
+		stats.groups++;
+		groupStart = groupEnd;
+	}
+
+	stats.commands = (uint32_t)commands.size();
+	stats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	draws.clear();
+	instances.clear();
+}
+
+void IndirectRenderer::mapInstancesToDraws()
+{
+	instanceDraws.resize(instances.size());
+	drawBounds.resize(draws.size() * 4);
+
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		const DrawElementsIndirectCommand& command = commands[i];
+		std::fill(instanceDraws.begin() + command.baseInstance, instanceDraws.begin() + command.baseInstance + command.instanceCount, (uint32_t)i);
+		memcpy(&drawBounds[i * 4], draws[i].bounds, sizeof(draws[i].bounds));
+	}
+}
+
+void IndirectRenderer::cullOnGpu()
+{
+	mapInstancesToDraws();
+
+	// Counted up by the culler for every visible instance, each command keeps room for all of its instances
+	for (DrawElementsIndirectCommand& command : commands)
+		command.instanceCount = 0;
+
+	gpuCuller->cull(viewProjection, instances, instanceDraws, drawBounds, commands);
+}
+
+void IndirectRenderer::cullOnCpu()
+{
+	mapInstancesToDraws();
+
+	uint32_t count = (uint32_t)instances.size();
+	frustumCuller->resize(count);
+
+	// The mesh's bounds moved by the instance transform, scaled by its largest axis
+	JobRange sphereJob = [this](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const float* m = instances[i].transform;
+			const float* b = &drawBounds[instanceDraws[i] * 4];
+
+			float scaleSquared = std::max(std::max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2], m[4] * m[4] + m[5] * m[5] + m[6] * m[6]),
+				m[8] * m[8] + m[9] * m[9] + m[10] * m[10]);
+
+			frustumCuller->setSphere(i,
+				m[0] * b[0] + m[4] * b[1] + m[8] * b[2] + m[12],
+				m[1] * b[0] + m[5] * b[1] + m[9] * b[2] + m[13],
+				m[2] * b[0] + m[6] * b[1] + m[10] * b[2] + m[14],
+				b[3] * std::sqrt(scaleSquared));
+		}
+	};
+
+	if (jobSystem)
+		jobSystem->parallelFor(count, FrustumCuller::CULL_GRAIN, sphereJob);
+	else
+		sphereJob(0, count);
+
+	uint32_t visibleCount = frustumCuller->cull(viewProjection, visibleInstances);
+
+	// Visible instances keep their order, so the ones of each command are still one run
+	for (DrawElementsIndirectCommand& command : commands)
+	{
+		auto first = std::lower_bound(visibleInstances.begin(), visibleInstances.end(), command.baseInstance);
+		auto last = std::lower_bound(first, visibleInstances.end(), command.baseInstance + command.instanceCount);
+		command.baseInstance = (GLuint)(first - visibleInstances.begin());
+		command.instanceCount = (GLuint)(last - first);
+	}
+
+	culledInstances.resize(visibleCount);
+	JobRange copyJob = [this](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			culledInstances[i] = instances[visibleInstances[i]];
+	};
+
+	if (jobSystem)
+		jobSystem->parallelFor(visibleCount, FrustumCuller::CULL_GRAIN, copyJob);
+	else
+		copyJob(0, visibleCount);
+
+	instances.swap(culledInstances);
+}
@@ -0,0 +1,115 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* IndirectRenderer.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "FrustumCuller.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MeshManager.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+class GpuCuller;
+
+// Last executed frame
+struct IndirectStats
+{
+	bool multiDraw;			// glMultiDrawElementsIndirect, otherwise the fallback loop
+	bool culled;			// Instances went through the GPU culler, its stats have the visible count
+	bool cpuCulled;			// Instances went through the frustum culler instead
+	uint32_t commands;
+	uint32_t instances;
+	uint32_t visible;		// Instances left after CPU culling, all of them otherwise
+	uint32_t drawCalls;		// GL draw calls issued, one per group with multi draw
+	uint32_t groups;		// Distinct program and arena pairs
+	double submitMs;		// Main thread time building, uploading and issuing the commands
+};
+
+// Draws many different meshes with a handful of calls. Meshes already share VBOs per layout (see MeshManager), so
+// every mesh of one arena drawn with one program becomes a command in a single glMultiDrawElementsIndirect.
+// Per draw data goes through the instance attributes, with each command's baseInstance pointing at its own
+// instances, so shaders only need SHADER_FEATURE_INSTANCED and no gl_DrawID (ARB_shader_draw_parameters). Needs GL 4.3, or ARB_multi_draw_indirect
+// with ARB_base_instance; without them the same commands are issued one by one.
+class IndirectRenderer
+{
+public:
+	IndirectRenderer();
+
+	// With a GPU culler the commands are built by its compute pass whenever it is ready, otherwise instances
+	// outside the frustum are dropped on the CPU by the frustum culler, with the job system filling in the spheres
+	bool init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache, MeshManager* primaryMeshes,
+		GpuCuller* primaryGpuCuller = nullptr, FrustumCuller* primaryFrustumCuller = nullptr, JobSystem* primaryJobSystem = nullptr);
+	void cleanup();
+
+	// Queues count instances of mesh for this frame, shader has to be built with SHADER_FEATURE_INSTANCED
+	void add(ShaderHandle shader, MeshHandle mesh, const InstanceData* instances, uint32_t count);
+
+	// Uploads the instances and command buffer and draws everything added since the last call
+	void execute();
+
+	// Takes instance transforms to clip space, uploaded as the model matrix and culled against. Identity by default
+	void setViewProjection(const float* matrix);
+
+	IndirectStats getStats() const { return stats; }
+	bool hasMultiDraw() const { return multiDraw != nullptr; }
+
+private:
+	struct IndirectDraw
+	{
+		ShaderHandle shader;
+		GLuint vertexArray;
+		DrawElementsIndirectCommand command;
+		float bounds[4];
+	};
+
+	// Systems
+	Logger* logger;
+	ShaderManager* shaderManager;
+	GLStateCache* stateCache;
+	MeshManager* meshes;
+	GpuCuller* gpuCuller;
+	FrustumCuller* frustumCuller;
+	JobSystem* jobSystem;
+
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDraw;
+
+	// Instances followed by the commands, orphaned every frame. A million instances do not fit in the
+	// renderer's upload ring, so this grows to the largest frame instead
+	GLuint buffer;
+	size_t bufferSize;
+
+	std::vector<IndirectDraw> draws;
+	std::vector<InstanceData> instances;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<uint32_t> instanceDraws;
+	std::vector<float> drawBounds;
+	std::vector<uint32_t> visibleInstances;
+	std::vector<InstanceData> culledInstances;
+	float viewProjection[16];
+	IndirectStats stats;
+
+	void bindInstances(GLuint instanceBuffer, GLintptr offset);
+	void mapInstancesToDraws();
+	void cullOnGpu();
+	void cullOnCpu();
+};
\ No newline at end of file
@@ -0,0 +1,122 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* JobSystem.cpp
+*/
+
+#include <algorithm>
+
+#include "JobSystem.h"
+
+JobSystem::JobSystem()
+	: logger(nullptr), running(false), generation(0), busyWorkers(0), job(nullptr), count(0), grain(1), next(0)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	cleanup();
+}
+
+bool JobSystem::init(Logger* primaryLogger, unsigned int workerCount)
+{
+	logger = primaryLogger;
+	running = true;
+
+	if (workerCount == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.emplace_back(&JobSystem::workerLoop, this);
+
+	if (logger)
+		OF_LOG(*logger, LOG_LVL_INFO, "Job system running on {} threads", getThreadCount());
+
+	return true;
+}
+
+void JobSystem::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void JobSystem::parallelFor(uint32_t rangeCount, uint32_t rangeGrain, const JobRange& rangeJob)
+{
+	if (rangeCount == 0)
+		return;
+
+	rangeGrain = std::max(rangeGrain, 1u);
+
+	// Not worth waking anyone for a single range
+	if (workers.empty() || rangeCount <= rangeGrain)
+	{
+		rangeJob(0, rangeCount);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &rangeJob;
+		count = rangeCount;
+		grain = rangeGrain;
+		next = 0;
+		busyWorkers = (uint32_t)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	runRanges();
+
+	// Every worker checks in, even ones that woke too late to get a range, so none of them
+	// can still be looking at this job when the next parallelFor starts
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyWorkers == 0; });
+	job = nullptr;
+}
+
+void JobSystem::runRanges()
+{
+	for (;;)
+	{
+		uint32_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+		if (begin >= count)
+			break;
+
+		(*job)(begin, std::min(begin + grain, count));
+	}
+}
+
+void JobSystem::workerLoop()
+{
+	uint64_t seen = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return generation != seen || !running; });
+
+			if (!running)
+				break;
+
+			seen = generation;
+		}
+
+		runRanges();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			finished.notify_one();
+	}
+}
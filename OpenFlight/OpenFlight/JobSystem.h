@@ -0,0 +1,63 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* JobSystem.h
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+
+// Runs on one of the threads with a range [begin, end) of the work
+typedef std::function<void(uint32_t begin, uint32_t end)> JobRange;
+
+// Worker threads for data parallel work. parallelFor splits the work into ranges that the workers and the
+// calling thread pull from a shared counter until none are left, so uneven ranges balance out on their own.
+// Only one thread may be inside parallelFor at a time, any thread can call it as long as calls never overlap.
+// In OpenFlight the main thread uses it for benchmarks before the render thread starts, then only the render
+// thread does (CPU culling). Calling it from inside a job is not allowed either.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	// 0 workers picks one less than the number of hardware threads, the calling thread is the last one
+	bool init(Logger* primaryLogger, unsigned int workerCount = 0);
+	void cleanup();
+
+	// Returns once every range of [0, count) has run, ranges are at most grain long
+	void parallelFor(uint32_t count, uint32_t grain, const JobRange& job);
+
+	uint32_t getThreadCount() const { return (uint32_t)workers.size() + 1; }
+
+private:
+	// Systems
+	Logger* logger;
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	bool running;
+	uint64_t generation;		// Counted up for every parallelFor, workers wake when it changes
+	uint32_t busyWorkers;		// Workers that have not finished the current parallelFor
+
+	// Current parallelFor
+	const JobRange* job;
+	uint32_t count;
+	uint32_t grain;
+	std::atomic<uint32_t> next;
+
+	void workerLoop();
+	void runRanges();
+};
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogConsole.cpp
+*/
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "LogConsole.h"
+
+static const char* ansiColour[4] = { "\x1b[31m", "\x1b[33m", "\x1b[32m", "\x1b[36m" };
+static const char ansiReset[] = "\x1b[0m";
+
+LogConsole::LogConsole()
+	: backend(LOG_CONSOLE_ANSI), colours(true), currentLevel(-1), used(0)
+{
+}
+
+void LogConsole::init(logConsoleBackend consoleBackend)
+{
+	backend = consoleBackend;
+	currentLevel = -1;
+	used = 0;
+
+#ifdef _WIN32
+	colours = _isatty(_fileno(stdout)) != 0;
+
+	if (colours && backend == LOG_CONSOLE_ANSI)
+	{
+		// Windows 10 consoles understand escape codes once virtual terminal processing is switched on
+		HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+		DWORD mode = 0;
+
+		if (!GetConsoleMode(hConsole, &mode) || !SetConsoleMode(hConsole, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+			backend = LOG_CONSOLE_WIN32;
+	}
+#else
+	colours = isatty(STDOUT_FILENO) != 0;
+
+	// There is no console attribute API outside of Windows
+	backend = LOG_CONSOLE_ANSI;
+#endif
+}
+
+void LogConsole::write(logLevel lvl, const char* msg, size_t length)
+{
+	if (colours && backend == LOG_CONSOLE_WIN32 && lvl != currentLevel)
+	{
+		// The attribute applies to whatever is written next, so everything buffered so far has to go out first
+		flush();
+		setWin32Colour(lvl);
+	}
+
+	if (colours && backend == LOG_CONSOLE_ANSI)
+		append(ansiColour[lvl], strlen(ansiColour[lvl]));
+
+	append(logLevelMsg[lvl], strlen(logLevelMsg[lvl]));
+	append(msg, length);
+
+	if (colours && backend == LOG_CONSOLE_ANSI)
+		append(ansiReset, sizeof(ansiReset) - 1);
+
+	append("\n", 1);
+}
+
+void LogConsole::flush()
+{
+	if (used > 0)
+	{
+		emit(buffer, used);
+		used = 0;
+	}
+
+	if (colours && backend == LOG_CONSOLE_WIN32 && currentLevel != -1)
+		setWin32Colour(-1);
+}
+
+void LogConsole::append(const char* data, size_t length)
+{
+	if (used + length > sizeof(buffer))
+	{
+		flush();
+
+		// Too big to ever be buffered, send it on its own
+		if (length > sizeof(buffer))
+		{
+			emit(data, length);
+			return;
+		}
+	}
+
+	memcpy(buffer + used, data, length);
+	used += length;
+}
+
+void LogConsole::emit(const char* data, size_t length)
+{
+#ifdef _WIN32
+	HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	while (length > 0)
+	{
+		DWORD written = 0;
+		if (!WriteFile(hConsole, data, (DWORD)length, &written, NULL) || written == 0)
+			return;
+
+		data += written;
+		length -= written;
+	}
+#else
+	while (length > 0)
+	{
+		ssize_t written = ::write(STDOUT_FILENO, data, length);
+		if (written <= 0)
+			return;
+
+		data += written;
+		length -= (size_t)written;
+	}
+#endif
+}
+
+void LogConsole::setWin32Colour(int lvl)
+{
+#ifdef _WIN32
+	HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	switch (lvl)
+	{
+	case LOG_LVL_ERR:
+		SetConsoleTextAttribute(hConsole, FOREGROUND_RED);
+		break;
+	case LOG_LVL_WRN:
+		SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_GREEN);
+		break;
+	case LOG_LVL_INFO:
+		SetConsoleTextAttribute(hConsole, FOREGROUND_GREEN);
+		break;
+	case LOG_LVL_DEBUG:
+		SetConsoleTextAttribute(hConsole, FOREGROUND_BLUE | FOREGROUND_GREEN);
+		break;
+	default:
+		SetConsoleTextAttribute(hConsole, 15);
+		break;
+	}
+#endif
+
+	currentLevel = lvl;
+}
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogConsole.h
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include "LogFormat.h"
+
+enum logConsoleBackend {
+	LOG_CONSOLE_ANSI = 0,	// Colours as ANSI escape codes, a whole batch of lines goes out in one write
+	LOG_CONSOLE_WIN32 = 1,	// SetConsoleTextAttribute between lines of a different level, for old Windows consoles
+};
+
+// Console output for the logger. Lines are collected in a buffer and written out by flush(),
+// the logger calls it once per batch (or once per line when logging synchronously).
+// Not thread safe, the logger only uses it with its output mutex held.
+class LogConsole
+{
+public:
+	LogConsole();
+
+	// Falls back to LOG_CONSOLE_WIN32 if the Windows console does not support escape codes.
+	// Colours are left out entirely when stdout is not a terminal
+	void init(logConsoleBackend consoleBackend);
+
+	void write(logLevel lvl, const char* msg, size_t length);
+	void flush();
+
+	logConsoleBackend getBackend() const { return backend; }
+
+private:
+	logConsoleBackend backend;
+	bool colours;
+	int currentLevel;	// Level the Win32 console attribute is set to, -1 for the default
+
+	char buffer[16 * 1024];
+	size_t used;
+
+	void append(const char* data, size_t length);
+	void emit(const char* data, size_t length);
+	void setWin32Colour(int lvl);
+};
\ No newline at end of file
@@ -0,0 +1,261 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogFileSink.cpp
+*/
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "LogFileSink.h"
+
+// Segments are a multiple of this, it covers both the page size and the Windows allocation granularity
+const size_t LOG_SEGMENT_ALIGNMENT = 64 * 1024;
+
+LogFileSink::LogFileSink()
+	: current(), next(), used(0), segmentSize(0), segmentIndex(0), syncInterval(1000)
+{
+}
+
+LogFileSink::~LogFileSink()
+{
+	close();
+}
+
+bool LogFileSink::open(const char* fileName, size_t size, unsigned int syncIntervalMs)
+{
+	close();
+
+	// OpenFlight.log rotates into OpenFlight.1.log, OpenFlight.2.log etc
+	baseName = fileName;
+	extension.clear();
+
+	size_t dot = baseName.find_last_of('.');
+	size_t slash = baseName.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+	{
+		extension = baseName.substr(dot);
+		baseName.resize(dot);
+	}
+
+	segmentSize = (size + LOG_SEGMENT_ALIGNMENT - 1) / LOG_SEGMENT_ALIGNMENT * LOG_SEGMENT_ALIGNMENT;
+	if (segmentSize == 0)
+		segmentSize = LOG_SEGMENT_ALIGNMENT;
+
+	// Rotated segments of an earlier run would otherwise be mixed in with this one's, or pre-created over and
+	// deleted again by close(). Segments are numbered without gaps, so stop at the first one that is missing
+	uint32_t stale = 1;
+	while (removeSegment(stale))
+		stale++;
+
+	segmentIndex = 0;
+	used = 0;
+	syncInterval = std::chrono::milliseconds(syncIntervalMs);
+	lastSync = std::chrono::steady_clock::now();
+
+	return mapSegment(current, 0);
+}
+
+void LogFileSink::close()
+{
+	for (RetiredSegment& segment : retired)
+		finalizeSegment(segment.segment, segment.used);
+	retired.clear();
+
+	if (current.base)
+		finalizeSegment(current, used);
+
+	// The pre-created segment was never written to, do not leave an empty file behind
+	if (next.base)
+	{
+		finalizeSegment(next, 0);
+		removeSegment(segmentIndex + 1);
+	}
+
+	used = 0;
+}
+
+void LogFileSink::write(const char* data, size_t length)
+{
+	while (length > 0 && current.base)
+	{
+		if (used == current.size && !rotate())
+			return;
+
+		size_t count = current.size - used;
+		if (count > length)
+			count = length;
+
+		memcpy(current.base + used, data, count);
+		used += count;
+		data += count;
+		length -= count;
+	}
+}
+
+bool LogFileSink::rotate()
+{
+	// Normally maintain() has mapped the next segment already, only map it here if it could not keep up
+	if (!next.base && !mapSegment(next, segmentIndex + 1))
+		return false;
+
+	RetiredSegment old;
+	old.segment = current;
+	old.used = used;
+	retired.push_back(old);
+
+	current = next;
+	next = Segment();
+	used = 0;
+	segmentIndex++;
+
+	return true;
+}
+
+void LogFileSink::maintain()
+{
+	for (RetiredSegment& segment : retired)
+		finalizeSegment(segment.segment, segment.used);
+	retired.clear();
+
+	if (!current.base)
+		return;
+
+	if (!next.base && used > current.size / 2)
+		mapSegment(next, segmentIndex + 1);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastSync >= syncInterval)
+	{
+		syncSegment(current, used);
+		lastSync = now;
+	}
+}
+
+std::string LogFileSink::segmentName(uint32_t index) const
+{
+	if (index == 0)
+		return baseName + extension;
+
+	return baseName + "." + std::to_string(index) + extension;
+}
+
+#ifdef _WIN32
+
+bool LogFileSink::mapSegment(Segment& segment, uint32_t index)
+{
+	HANDLE file = CreateFileA(segmentName(index).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)segmentSize >> 32), (DWORD)segmentSize, NULL);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, segmentSize);
+	if (!base)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	segment.file = file;
+	segment.mapping = mapping;
+	segment.base = (char*)base;
+	segment.size = segmentSize;
+
+	return true;
+}
+
+void LogFileSink::syncSegment(Segment& segment, size_t length)
+{
+	if (length > 0)
+		FlushViewOfFile(segment.base, length);
+}
+
+void LogFileSink::finalizeSegment(Segment& segment, size_t length)
+{
+	UnmapViewOfFile(segment.base);
+	CloseHandle(segment.mapping);
+
+	// Cut the unused, zero filled tail of the mapping off the file
+	LARGE_INTEGER end;
+	end.QuadPart = (LONGLONG)length;
+	SetFilePointerEx(segment.file, end, NULL, FILE_BEGIN);
+	SetEndOfFile(segment.file);
+	CloseHandle(segment.file);
+
+	segment = Segment();
+}
+
+bool LogFileSink::removeSegment(uint32_t index)
+{
+	return DeleteFileA(segmentName(index).c_str()) != 0;
+}
+
+#else
+
+bool LogFileSink::mapSegment(Segment& segment, uint32_t index)
+{
+	int fd = ::open(segmentName(index).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, (off_t)segmentSize) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* base = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+	{
+		::close(fd);
+		return false;
+	}
+
+	segment.fd = fd;
+	segment.base = (char*)base;
+	segment.size = segmentSize;
+
+	return true;
+}
+
+void LogFileSink::syncSegment(Segment& segment, size_t length)
+{
+	// MS_ASYNC only schedules the write back, the writer thread never waits on the disk
+	if (length > 0)
+		msync(segment.base, length, MS_ASYNC);
+}
+
+void LogFileSink::finalizeSegment(Segment& segment, size_t length)
+{
+	munmap(segment.base, segment.size);
+
+	// Cut the unused, zero filled tail of the mapping off the file
+	if (ftruncate(segment.fd, (off_t)length) != 0)
+	{
+		// Nothing sensible to do, the file just keeps its trailing zeros
+	}
+	::close(segment.fd);
+
+	segment = Segment();
+}
+
+bool LogFileSink::removeSegment(uint32_t index)
+{
+	return unlink(segmentName(index).c_str()) == 0;
+}
+
+#endif
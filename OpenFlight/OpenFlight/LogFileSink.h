@@ -0,0 +1,81 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogFileSink.h
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Log file output backed by a pre-sized memory mapped segment, so writing is a memcpy instead of a syscall.
+// When a segment is full the sink rotates to a new file (OpenFlight.log, OpenFlight.1.log, ...),
+// open() deletes the rotated files an earlier run left behind.
+// The next segment is created ahead of time and old ones are finalized later by maintain(),
+// which the logger's writer thread calls, so rotating is just swapping two pointers.
+// Not thread safe, the logger only uses it with its output mutex held.
+class LogFileSink
+{
+public:
+	LogFileSink();
+	~LogFileSink();
+
+	bool open(const char* fileName, size_t segmentSize, unsigned int syncIntervalMs);
+	void close();
+	bool isOpen() const { return current.base != nullptr; }
+
+	void write(const char* data, size_t length);
+	size_t remaining() const { return current.size - used; }
+	size_t getUsed() const { return used; }
+
+	// Switches to the next segment even if the current one still has space
+	bool rotate();
+
+	// Background housekeeping: msync every syncIntervalMs, map the next segment once the
+	// current one is half full and truncate/unmap retired segments
+	void maintain();
+
+	uint32_t getSegmentIndex() const { return segmentIndex; }
+
+private:
+	struct Segment
+	{
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		int fd;
+#endif
+		char* base;
+		size_t size;
+	};
+
+	struct RetiredSegment
+	{
+		Segment segment;
+		size_t used;
+	};
+
+	Segment current;
+	Segment next;
+	size_t used;
+	std::vector<RetiredSegment> retired;
+
+	std::string baseName;
+	std::string extension;
+	size_t segmentSize;
+	uint32_t segmentIndex;
+
+	std::chrono::milliseconds syncInterval;
+	std::chrono::steady_clock::time_point lastSync;
+
+	std::string segmentName(uint32_t index) const;
+	bool mapSegment(Segment& segment, uint32_t index);
+	void syncSegment(Segment& segment, size_t length);
+	void finalizeSegment(Segment& segment, size_t length);
+	bool removeSegment(uint32_t index);
+};
\ No newline at end of file
@@ -0,0 +1,297 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogFormat.cpp
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "LogFormat.h"
+
+const char* const logLevelMsg[4] = { "[ERROR]: ", "[WARNING]: ", "[INFO]: ", "[DEBUG]: " };
+
+// Small output cursor, everything past the end of the buffer is silently dropped
+struct LogWriter
+{
+	char* out;
+	char* end;
+
+	void put(char c)
+	{
+		if (out < end)
+			*out++ = c;
+	}
+
+	void put(const char* str, size_t length)
+	{
+		size_t space = (size_t)(end - out);
+		if (length > space)
+			length = space;
+
+		memcpy(out, str, length);
+		out += length;
+	}
+};
+
+static void writeUnsigned(LogWriter& writer, uint64_t value, unsigned int base)
+{
+	char digits[24];
+	int count = 0;
+
+	do
+	{
+		digits[count++] = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value != 0);
+
+	while (count > 0)
+		writer.put(digits[--count]);
+}
+
+static void writeArg(LogWriter& writer, const LogArg& arg)
+{
+	switch (arg.type)
+	{
+	case LOG_ARG_INT:
+		if (arg.i < 0)
+		{
+			writer.put('-');
+			writeUnsigned(writer, 0 - (uint64_t)arg.i, 10);
+		}
+		else
+		{
+			writeUnsigned(writer, (uint64_t)arg.i, 10);
+		}
+		break;
+	case LOG_ARG_UINT:
+		writeUnsigned(writer, arg.u, 10);
+		break;
+	case LOG_ARG_DOUBLE:
+	{
+		char number[32];
+		int length = snprintf(number, sizeof(number), "%.10g", arg.d);
+		if (length > 0)
+			writer.put(number, (size_t)length < sizeof(number) ? (size_t)length : sizeof(number) - 1);
+		break;
+	}
+	case LOG_ARG_CHAR:
+		writer.put((char)arg.i);
+		break;
+	case LOG_ARG_BOOL:
+		if (arg.u)
+			writer.put("true", 4);
+		else
+			writer.put("false", 5);
+		break;
+	case LOG_ARG_STRING:
+		writer.put(arg.s, strlen(arg.s));
+		break;
+	case LOG_ARG_POINTER:
+		writer.put("0x", 2);
+		writeUnsigned(writer, (uint64_t)(uintptr_t)arg.p, 16);
+		break;
+	default:
+		break;
+	}
+}
+
+size_t formatLogMessage(char* buffer, size_t bufferSize, const char* fmt, const LogArg* args, size_t argCount)
+{
+	if (bufferSize == 0)
+		return 0;
+
+	LogWriter writer = { buffer, buffer + bufferSize - 1 };
+	size_t nextArg = 0;
+
+	for (const char* c = fmt; *c; c++)
+	{
+		if (c[0] == '{' && c[1] == '{')
+		{
+			writer.put('{');
+			c++;
+		}
+		else if (c[0] == '}' && c[1] == '}')
+		{
+			writer.put('}');
+			c++;
+		}
+		else if (c[0] == '{' && c[1] == '}')
+		{
+			// More placeholders than arguments, print them as is so the mistake is visible
+			if (nextArg < argCount)
+				writeArg(writer, args[nextArg++]);
+			else
+				writer.put("{}", 2);
+			c++;
+		}
+		else
+		{
+			writer.put(*c);
+		}
+	}
+
+	*writer.out = '\0';
+
+	return (size_t)(writer.out - buffer);
+}
+
+size_t writeLogVarint(char* out, uint64_t value)
+{
+	size_t count = 0;
+
+	while (value >= 0x80)
+	{
+		out[count++] = (char)(value | 0x80);
+		value >>= 7;
+	}
+	out[count++] = (char)value;
+
+	return count;
+}
+
+bool readLogVarint(const char*& data, const char* end, uint64_t& value)
+{
+	value = 0;
+
+	for (unsigned int shift = 0; data < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = (uint8_t)*data++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+size_t packLogArgs(char* buffer, size_t bufferSize, const LogArg* args, size_t argCount)
+{
+	size_t used = 0;
+
+	if (argCount > LOG_MAX_ARGS)
+		argCount = LOG_MAX_ARGS;
+
+	for (size_t i = 0; i < argCount; i++)
+	{
+		const LogArg& arg = args[i];
+
+		// Worst case for everything except strings is a 10 byte varint
+		char scratch[10];
+		size_t length = 0;
+
+		switch (arg.type)
+		{
+		case LOG_ARG_INT:
+			// Zigzag so small negative numbers stay small
+			length = writeLogVarint(scratch, ((uint64_t)arg.i << 1) ^ (uint64_t)(arg.i >> 63));
+			break;
+		case LOG_ARG_UINT:
+		case LOG_ARG_BOOL:
+			length = writeLogVarint(scratch, arg.u);
+			break;
+		case LOG_ARG_DOUBLE:
+			memcpy(scratch, &arg.d, sizeof(double));
+			length = sizeof(double);
+			break;
+		case LOG_ARG_CHAR:
+			scratch[length++] = (char)arg.i;
+			break;
+		case LOG_ARG_POINTER:
+			length = writeLogVarint(scratch, (uint64_t)(uintptr_t)arg.p);
+			break;
+		case LOG_ARG_STRING:
+		{
+			// Stored with its terminator so unpacked arguments can point straight into the data
+			size_t stringLength = strlen(arg.s);
+			length = writeLogVarint(scratch, stringLength);
+
+			// Cut to whatever room is left like a formatted message would be, a shorter length never needs a longer varint
+			if (used + length + stringLength + 1 > bufferSize)
+			{
+				if (used + length + 1 > bufferSize)
+					return used;
+
+				stringLength = bufferSize - used - length - 1;
+				length = writeLogVarint(scratch, stringLength);
+			}
+
+			memcpy(buffer + used, scratch, length);
+			memcpy(buffer + used + length, arg.s, stringLength);
+			buffer[used + length + stringLength] = '\0';
+			used += length + stringLength + 1;
+			continue;
+		}
+		default:
+			return used;
+		}
+
+		if (used + length > bufferSize)
+			return used;
+
+		memcpy(buffer + used, scratch, length);
+		used += length;
+	}
+
+	return used;
+}
+
+size_t unpackLogArgs(const char* data, size_t size, const uint8_t* types, size_t typeCount, LogArg* args)
+{
+	const char* end = data + size;
+	size_t count = 0;
+
+	if (typeCount > LOG_MAX_ARGS)
+		typeCount = LOG_MAX_ARGS;
+
+	while (data < end && count < typeCount)
+	{
+		LogArg& arg = args[count];
+		arg.type = (logArgType)types[count];
+
+		uint64_t value = 0;
+		switch (arg.type)
+		{
+		case LOG_ARG_INT:
+			if (!readLogVarint(data, end, value))
+				return count;
+			arg.i = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+			break;
+		case LOG_ARG_UINT:
+		case LOG_ARG_BOOL:
+			if (!readLogVarint(data, end, value))
+				return count;
+			arg.u = value;
+			break;
+		case LOG_ARG_DOUBLE:
+			if (end - data < (ptrdiff_t)sizeof(double))
+				return count;
+			memcpy(&arg.d, data, sizeof(double));
+			data += sizeof(double);
+			break;
+		case LOG_ARG_CHAR:
+			if (data >= end)
+				return count;
+			arg.i = *data++;
+			break;
+		case LOG_ARG_POINTER:
+			if (!readLogVarint(data, end, value))
+				return count;
+			arg.p = (const void*)(uintptr_t)value;
+			break;
+		case LOG_ARG_STRING:
+			if (!readLogVarint(data, end, value) || (uint64_t)(end - data) < value + 1)
+				return count;
+			arg.s = data;
+			data += value + 1;
+			break;
+		default:
+			return count;
+		}
+
+		count++;
+	}
+
+	return count;
+}
\ No newline at end of file
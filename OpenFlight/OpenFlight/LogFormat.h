@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* LogFormat.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum logLevel {
+	LOG_LVL_ERR = 0,
+	LOG_LVL_WRN = 1,
+	LOG_LVL_INFO = 2,
+	LOG_LVL_DEBUG = 3,
+};
+
+// Line prefix for each level e.g. "[INFO]: "
+extern const char* const logLevelMsg[4];
+
+enum logArgType {
+	LOG_ARG_INT = 0,
+	LOG_ARG_UINT = 1,
+	LOG_ARG_DOUBLE = 2,
+	LOG_ARG_CHAR = 3,
+	LOG_ARG_BOOL = 4,
+	LOG_ARG_STRING = 5,
+	LOG_ARG_POINTER = 6,
+};
+
+// Type erased argument for formatted logging. Only holds a copy of numbers and a pointer to
+// strings so building the argument list never allocates
+struct LogArg
+{
+	logArgType type;
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+		const char* s;
+		const void* p;
+	};
+
+	LogArg() : type(LOG_ARG_INT), i(0) {}
+	LogArg(bool v) : type(LOG_ARG_BOOL), u(v) {}
+	LogArg(char v) : type(LOG_ARG_CHAR), i(v) {}
+	LogArg(signed char v) : type(LOG_ARG_INT), i(v) {}
+	LogArg(unsigned char v) : type(LOG_ARG_UINT), u(v) {}
+	LogArg(short v) : type(LOG_ARG_INT), i(v) {}
+	LogArg(unsigned short v) : type(LOG_ARG_UINT), u(v) {}
+	LogArg(int v) : type(LOG_ARG_INT), i(v) {}
+	LogArg(unsigned int v) : type(LOG_ARG_UINT), u(v) {}
+	LogArg(long v) : type(LOG_ARG_INT), i(v) {}
+	LogArg(unsigned long v) : type(LOG_ARG_UINT), u(v) {}
+	LogArg(long long v) : type(LOG_ARG_INT), i(v) {}
+	LogArg(unsigned long long v) : type(LOG_ARG_UINT), u(v) {}
+	LogArg(float v) : type(LOG_ARG_DOUBLE), d(v) {}
+	LogArg(double v) : type(LOG_ARG_DOUBLE), d(v) {}
+	LogArg(const char* v) : type(LOG_ARG_STRING), s(v ? v : "(null)") {}
+	LogArg(const unsigned char* v) : type(LOG_ARG_STRING), s(v ? (const char*)v : "(null)") {} // glGetString results
+	LogArg(const std::string& v) : type(LOG_ARG_STRING), s(v.c_str()) {}
+	LogArg(const void* v) : type(LOG_ARG_POINTER), p(v) {}
+};
+
+// Expands every {} in fmt with the next argument ({{ and }} print a literal brace) into buffer.
+// Output is truncated to bufferSize - 1 characters and always null terminated.
+// Returns the number of characters written, excluding the terminator.
+size_t formatLogMessage(char* buffer, size_t bufferSize, const char* fmt, const LogArg* args, size_t argCount);
+
+// -- BINARY LOG FORMAT --
+// File header: magic, version (uint32), timestamp ticks per second (uint64)
+// followed by chunks. Integers are LEB128 varints. Every chunk starts with a tag varint, its low two bits are the
+// logChunkType and the rest is the site id (the level for text chunks), so events of the first 32 sites need
+// a single byte for both.
+//   LOG_CHUNK_SITE:  tag, level (byte), line, file length, file, format length, format, argument count (byte),
+//                    one logArgType byte per argument
+//   LOG_CHUNK_EVENT: tag, zigzag timestamp delta, argument bytes, packed arguments
+//   LOG_CHUNK_TEXT:  tag, zigzag timestamp delta, length, message
+// A site chunk is always written before the first event that references it, so a log is self describing.
+// Argument types are fixed per call site, so they are only stored in the site chunk
+const char LOG_BINARY_MAGIC[4] = { 'O', 'F', 'L', 'B' };
+const uint32_t LOG_BINARY_VERSION = 2;
+const size_t LOG_BINARY_HEADER_SIZE = 16;
+
+// Microseconds, timestamps in the file count from when logging started
+const uint64_t LOG_BINARY_TICKS_PER_SECOND = 1000000;
+
+// Most arguments a single call site can pass
+const size_t LOG_MAX_ARGS = 16;
+
+enum logChunkType {
+	LOG_CHUNK_SITE = 1,
+	LOG_CHUNK_EVENT = 2,
+	LOG_CHUNK_TEXT = 3,
+};
+
+const unsigned int LOG_CHUNK_TAG_BITS = 2;
+
+// out must have room for 10 bytes. Returns the number of bytes written
+size_t writeLogVarint(char* out, uint64_t value);
+bool readLogVarint(const char*& data, const char* end, uint64_t& value);
+
+// Serializes the raw argument values (string contents are copied) into buffer, without their types.
+// A string that does not fit is cut short, arguments after it are left out. Returns the number of bytes used
+size_t packLogArgs(char* buffer, size_t bufferSize, const LogArg* args, size_t argCount);
+
+// Reverse of packLogArgs given the types of the call site, strings in args point into data.
+// Returns the number of arguments read
+size_t unpackLogArgs(const char* data, size_t size, const uint8_t* types, size_t typeCount, LogArg* args);
\ No newline at end of file
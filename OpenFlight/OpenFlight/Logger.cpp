@@ -4,63 +4,517 @@
 * Logger.cpp
 */
 
-#include <iostream>
-#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #include "Logger.h"
 
-bool Logger::initializeLogging()
+// Sized so a whole record is 256 bytes, longer messages are truncated
+const unsigned int LOG_MSG_SIZE = 236;
+
+// Records per thread, must be a power of two
+const unsigned int LOG_RING_SIZE = 1024;
+
+struct LogRecord
+{
+	uint64_t timestamp;
+	logLevel lvl;
+	uint32_t siteId;	// Non zero when msg holds packed arguments for a binary log instead of text
+	uint32_t length;
+	char msg[LOG_MSG_SIZE];
+};
+
+// Single producer (the owning thread) / single consumer (the writer thread) ring buffer.
+// head and tail live on separate cache lines so the two sides do not false share.
+// busy is set by the producer while it is inside pushRecord, cleanup waits for it before freeing the ring
+struct LogRing
+{
+	alignas(64) std::atomic<uint32_t> head{ 0 };
+	std::atomic<bool> busy{ false };
+	alignas(64) std::atomic<uint32_t> tail{ 0 };
+	LogRecord records[LOG_RING_SIZE];
+};
+
+// Every call to initializeLogging gets a new generation so a thread never reuses a ring
+// that belonged to a previous run of the logger
+static std::atomic<uint32_t> loggerGeneration{ 0 };
+
+static thread_local const Logger* threadRingOwner = nullptr;
+static thread_local uint32_t threadRingGeneration = 0;
+static thread_local LogRing* threadRing = nullptr;
+
+// Every OF_LOG call site that has been hit, a site's id is its index + 1
+static std::mutex siteMutex;
+static std::vector<const LogSite*> siteTable;
+
+static uint64_t logTimestamp()
+{
+	return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+Logger::Logger()
+	: logToFile(false), logToConsole(true), maxLevel(LOG_LVL_DEBUG), writerRunning(false), generation(0), closed(true),
+	lastTimestamp(0), startTimestamp(0), writtenCount(0), droppedCount(0), blockedCount(0)
+{
+	// Messages logged before initializeLogging still go to the console
+	console.init(LOG_CONSOLE_ANSI);
+}
+
+Logger::~Logger()
+{
+	cleanup();
+}
+
+bool Logger::initializeLogging(const LoggerSettings& loggerSettings)
 {
-	// TODO: Initialize log file etc in here (Open file handle)
 	// TODO: From command line parameters setup if stuff should be logged to a file, console or both
+	cleanup();
+
+	settings = loggerSettings;
+	logToConsole = settings.logToConsole;
+	logToFile = settings.logToFile;
+
+	if (logToConsole)
+		console.init(settings.consoleBackend);
+
+	if (logToFile)
+	{
+		if (!fileSink.open(settings.logFileName, settings.logSegmentSize, settings.logSyncIntervalMs))
+		{
+			logToFile = false;
+			logOut(LOG_LVL_WRN, "Failed to open log file, logging to console only");
+		}
+		else
+		{
+			startTimestamp = logTimestamp();
+			writeFileHeader();
+		}
+	}
+
+	maxLevel = -1;
+	if (logToConsole && settings.consoleLevel > maxLevel)
+		maxLevel = settings.consoleLevel;
+	if (logToFile && settings.fileLevel > maxLevel)
+		maxLevel = settings.fileLevel;
+
+	if (settings.async)
+	{
+		generation = ++loggerGeneration;
+		closed = false;
+		writerRunning = true;
+		writerThread = std::thread(&Logger::writerLoop, this);
+	}
 
 	return true;
 }
 
 void Logger::cleanup()
 {
-	// TODO: Clean up here and maybe save any log files or queued entries
-	// TODO: Close any file handles as well
+	if (writerThread.joinable())
+	{
+		// New records go out synchronously from here on. Records already being pushed are finished first,
+		// so the final drain below sees every one of them and no producer still holds a ring when they are freed
+		closed = true;
+
+		// No ring is added once closed is set, but the writer still needs ringMutex to drain a blocked producer
+		std::vector<LogRing*> openRings;
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			for (const std::unique_ptr<LogRing>& ring : rings)
+				openRings.push_back(ring.get());
+		}
+
+		for (LogRing* ring : openRings)
+		{
+			while (ring->busy.load())
+				std::this_thread::yield();
+		}
+
+		// Stop the writer thread, it drains every ring one last time before exiting
+		writerRunning = false;
+		writerWake.notify_one();
+		writerThread.join();
+
+		std::lock_guard<std::mutex> lock(ringMutex);
+		rings.clear();
+	}
+
+	// Truncates the last segment to what was actually written
+	std::lock_guard<std::mutex> lock(outputMutex);
+	fileSink.close();
+	logToFile = false;
+}
+
+void Logger::logMessage(logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount)
+{
+	if (lvl < LOG_LVL_ERR || lvl > LOG_LVL_DEBUG)
+		return;
+
+	if (writerRunning.load(std::memory_order_relaxed) && pushRecord(lvl, siteId, fmt, args, argCount))
+		return;
+
+	// Synchronous path, used before initializeLogging, after cleanup or when async is off
+	if (!args)
+	{
+		std::lock_guard<std::mutex> lock(outputMutex);
+		writeOut(lvl, fmt, strlen(fmt), logTimestamp());
+		flushOutputs();
+	}
+	else
+	{
+		static thread_local LogRecord record;
+		fillRecord(record, lvl, siteId, fmt, args, argCount);
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		writeRecord(record);
+		flushOutputs();
+	}
+
+	writtenCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+LoggerStats Logger::getStats() const
+{
+	LoggerStats stats;
+	stats.written = writtenCount.load();
+	stats.dropped = droppedCount.load();
+	stats.blocked = blockedCount.load();
+
+	return stats;
+}
+
+uint32_t Logger::registerSite(LogSite& site, const LogArg* args, size_t argCount)
+{
+	std::lock_guard<std::mutex> lock(siteMutex);
+
+	// Another thread may have registered it while we were waiting
+	uint32_t siteId = site.id.load(std::memory_order_relaxed);
+	if (siteId != 0)
+		return siteId;
+
+	site.argCount = (uint8_t)std::min(argCount, LOG_MAX_ARGS);
+	for (size_t i = 0; i < site.argCount; i++)
+		site.argTypes[i] = (uint8_t)args[i].type;
+
+	siteTable.push_back(&site);
+	siteId = (uint32_t)siteTable.size();
+	site.id.store(siteId, std::memory_order_release);
+
+	return siteId;
+}
+
+LogRing* Logger::getThreadRing()
+{
+	uint32_t currentGeneration = generation.load(std::memory_order_acquire);
+	if (threadRingOwner == this && threadRingGeneration == currentGeneration)
+		return threadRing;
+
+	// First message from this thread, register a new ring with the writer unless cleanup already started
+	std::lock_guard<std::mutex> lock(ringMutex);
+	if (closed.load())
+		return nullptr;
+
+	rings.emplace_back(new LogRing());
+
+	threadRingOwner = this;
+	threadRingGeneration = currentGeneration;
+	threadRing = rings.back().get();
+
+	return threadRing;
 }
 
-void Logger::logOut(logLevel lvl, const char* msg)
+bool Logger::pushRecord(logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount)
 {
-	const char* logLevelMsg[4] = { "[ERROR]: ", "[WARNING]: ", "[INFO]: ", "[DEBUG]: " };
-	HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-	
-	// TODO: Allow for extra paramters to be passed into the function such as numbers etc for better logging
+	LogRing* ring = getThreadRing();
+	if (!ring)
+		return false;
 
-	switch (lvl)
+	// Pairs with cleanup setting closed and then waiting on busy, one of the two sides always sees the other
+	ring->busy.store(true);
+	if (closed.load())
 	{
-	case LOG_LVL_ERR:
-		SetConsoleTextAttribute(hConsole, FOREGROUND_RED);
+		ring->busy.store(false, std::memory_order_release);
+		return false;
+	}
 
-		std::cout << logLevelMsg[lvl] << msg << std::endl;
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE)
+	{
+		if (settings.overflowPolicy == LOG_OVERFLOW_DROP)
+		{
+			droppedCount.fetch_add(1, std::memory_order_relaxed);
+			ring->busy.store(false, std::memory_order_release);
+			return true;
+		}
 
-		SetConsoleTextAttribute(hConsole, 15);
-		break;
-	case LOG_LVL_WRN:
-		SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_GREEN);
+		blockedCount.fetch_add(1, std::memory_order_relaxed);
+		writerWake.notify_one();
 
-		std::cout << logLevelMsg[lvl] << msg << std::endl;
+		while (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE)
+		{
+			// The writer is gone, let the caller fall back to synchronous output
+			if (!writerRunning.load(std::memory_order_relaxed))
+			{
+				ring->busy.store(false, std::memory_order_release);
+				return false;
+			}
 
-		SetConsoleTextAttribute(hConsole, 15);
-		break;
-	case LOG_LVL_INFO:
-		SetConsoleTextAttribute(hConsole, FOREGROUND_GREEN);
+			std::this_thread::yield();
+		}
+	}
 
-		std::cout << logLevelMsg[lvl] << msg << std::endl;
+	// Fill the slot in place, the message is never copied twice
+	fillRecord(ring->records[head & (LOG_RING_SIZE - 1)], lvl, siteId, fmt, args, argCount);
 
-		SetConsoleTextAttribute(hConsole, 15);
-		break;
-	case LOG_LVL_DEBUG:
-		SetConsoleTextAttribute(hConsole, FOREGROUND_BLUE | FOREGROUND_GREEN);
+	ring->head.store(head + 1, std::memory_order_release);
+	ring->busy.store(false, std::memory_order_release);
 
-		std::cout << logLevelMsg[lvl] << msg << std::endl;
+	return true;
+}
+
+void Logger::fillRecord(LogRecord& record, logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount)
+{
+	size_t length;
 
-		SetConsoleTextAttribute(hConsole, 15);
-		break;
-	default:
-		break;
+	record.timestamp = logTimestamp();
+	record.lvl = lvl;
+	record.siteId = 0;
+
+	if (siteId != 0 && settings.binaryFile && logToFile)
+	{
+		// Binary logs defer formatting, only the raw argument values are kept
+		length = packLogArgs(record.msg, LOG_MSG_SIZE, args, argCount);
+		record.siteId = siteId;
+	}
+	else if (args)
+	{
+		length = formatLogMessage(record.msg, LOG_MSG_SIZE, fmt, args, argCount);
+	}
+	else
+	{
+		length = strlen(fmt);
+		if (length > LOG_MSG_SIZE)
+			length = LOG_MSG_SIZE;
+		memcpy(record.msg, fmt, length);
 	}
+
+	record.length = (uint32_t)length;
+}
+
+void Logger::writerLoop()
+{
+	std::vector<LogRecord> batch;
+	batch.reserve(LOG_RING_SIZE);
+
+	for (;;)
+	{
+		bool running = writerRunning.load();
+
+		if (drainRings(batch) > 0)
+		{
+			// Rings are per thread, interleave them back into the order the calls were made in
+			std::stable_sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) {
+				return a.timestamp < b.timestamp;
+			});
+
+			std::lock_guard<std::mutex> lock(outputMutex);
+			for (const LogRecord& record : batch)
+				writeRecord(record);
+			flushOutputs();
+
+			writtenCount.fetch_add(batch.size(), std::memory_order_relaxed);
+			batch.clear();
+			continue;
+		}
+
+		// Only exit once the rings were seen empty after cleanup asked us to stop
+		if (!running)
+			break;
+
+		if (logToFile)
+		{
+			std::lock_guard<std::mutex> outputLock(outputMutex);
+			fileSink.maintain();
+		}
+
+		std::unique_lock<std::mutex> lock(writerWakeMutex);
+		writerWake.wait_for(lock, std::chrono::milliseconds(2));
+	}
+}
+
+size_t Logger::drainRings(std::vector<LogRecord>& batch)
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+
+	for (const std::unique_ptr<LogRing>& ring : rings)
+	{
+		uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint32_t head = ring->head.load(std::memory_order_acquire);
+
+		for (; tail != head; tail++)
+			batch.push_back(ring->records[tail & (LOG_RING_SIZE - 1)]);
+
+		ring->tail.store(tail, std::memory_order_release);
+	}
+
+	return batch.size();
+}
+
+void Logger::writeRecord(const LogRecord& record)
+{
+	if (record.siteId == 0)
+	{
+		writeOut(record.lvl, record.msg, record.length, record.timestamp);
+		return;
+	}
+
+	const LogSite* site;
+	{
+		std::lock_guard<std::mutex> lock(siteMutex);
+		site = siteTable[record.siteId - 1];
+	}
+
+	// The console still wants text, format it here on the writer thread instead of at the call site
+	if (logToConsole && record.lvl <= settings.consoleLevel)
+	{
+		LogArg args[LOG_MAX_ARGS];
+		char text[LOG_MSG_SIZE + 1];
+
+		size_t argCount = unpackLogArgs(record.msg, record.length, site->argTypes, site->argCount, args);
+		size_t length = formatLogMessage(text, sizeof(text), site->fmt, args, argCount);
+		console.write(record.lvl, text, length);
+	}
+
+	if (logToFile && record.lvl <= settings.fileLevel)
+	{
+		// 3 varints and the arguments
+		char chunk[3 * 10 + LOG_MSG_SIZE];
+		size_t length = 0;
+		size_t fileLength = strlen(site->file);
+		size_t fmtLength = strlen(site->fmt);
+
+		// Worst case including the site chunk, a new segment starts over with no sites written
+		reserveFile(sizeof(chunk) + 4 * 10 + 2 + fileLength + fmtLength + site->argCount);
+
+		if (sitesWritten.size() <= record.siteId)
+			sitesWritten.resize(record.siteId + 1, false);
+
+		if (!sitesWritten[record.siteId])
+		{
+			length += writeLogVarint(chunk + length, ((uint64_t)record.siteId << LOG_CHUNK_TAG_BITS) | LOG_CHUNK_SITE);
+			chunk[length++] = (char)site->lvl;
+			length += writeLogVarint(chunk + length, (uint64_t)site->line);
+			length += writeLogVarint(chunk + length, fileLength);
+			fileSink.write(chunk, length);
+			fileSink.write(site->file, fileLength);
+
+			length = writeLogVarint(chunk, fmtLength);
+			fileSink.write(chunk, length);
+			fileSink.write(site->fmt, fmtLength);
+
+			chunk[0] = (char)site->argCount;
+			fileSink.write(chunk, 1);
+			fileSink.write((const char*)site->argTypes, site->argCount);
+
+			sitesWritten[record.siteId] = true;
+			length = 0;
+		}
+
+		int64_t delta = fileTimeDelta(record.timestamp);
+
+		length += writeLogVarint(chunk + length, ((uint64_t)record.siteId << LOG_CHUNK_TAG_BITS) | LOG_CHUNK_EVENT);
+		length += writeLogVarint(chunk + length, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+		length += writeLogVarint(chunk + length, record.length);
+		memcpy(chunk + length, record.msg, record.length);
+		length += record.length;
+
+		fileSink.write(chunk, length);
+	}
+}
+
+void Logger::writeOut(logLevel lvl, const char* msg, size_t length, uint64_t timestamp)
+{
+	if (logToConsole && lvl <= settings.consoleLevel)
+		console.write(lvl, msg, length);
+
+	if (logToFile && lvl <= settings.fileLevel)
+	{
+		if (settings.binaryFile)
+		{
+			char chunk[3 * 10];
+			size_t chunkLength = 0;
+
+			reserveFile(sizeof(chunk) + length);
+
+			int64_t delta = fileTimeDelta(timestamp);
+
+			chunkLength += writeLogVarint(chunk + chunkLength, ((uint64_t)lvl << LOG_CHUNK_TAG_BITS) | LOG_CHUNK_TEXT);
+			chunkLength += writeLogVarint(chunk + chunkLength, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+			chunkLength += writeLogVarint(chunk + chunkLength, length);
+			fileSink.write(chunk, chunkLength);
+			fileSink.write(msg, length);
+		}
+		else
+		{
+			size_t prefixLength = strlen(logLevelMsg[lvl]);
+
+			reserveFile(prefixLength + length + 1);
+			fileSink.write(logLevelMsg[lvl], prefixLength);
+			fileSink.write(msg, length);
+			fileSink.write("\n", 1);
+		}
+	}
+}
+
+void Logger::reserveFile(size_t length)
+{
+	// Start a new segment rather than splitting a line or chunk over two files, unless it would
+	// not fit in an empty segment either
+	if (fileSink.remaining() >= length || fileSink.getUsed() == 0)
+		return;
+
+	if (fileSink.rotate())
+		writeFileHeader();
+}
+
+void Logger::writeFileHeader()
+{
+	if (!settings.binaryFile)
+		return;
+
+	// Every segment repeats the header and its own site chunks so it can be decoded on its own.
+	// Timestamps restart relative to when logging started
+	char header[LOG_BINARY_HEADER_SIZE];
+
+	memcpy(header, LOG_BINARY_MAGIC, 4);
+	memcpy(header + 4, &LOG_BINARY_VERSION, 4);
+	memcpy(header + 8, &LOG_BINARY_TICKS_PER_SECOND, 8);
+	fileSink.write(header, sizeof(header));
+
+	sitesWritten.clear();
+	lastTimestamp = 0;
+}
+
+int64_t Logger::fileTimeDelta(uint64_t timestamp)
+{
+	// Microseconds since logging started, rounding the absolute time keeps deltas from drifting
+	std::chrono::steady_clock::duration sinceStart((std::chrono::steady_clock::rep)(timestamp - startTimestamp));
+	uint64_t fileTime = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(sinceStart).count();
+
+	int64_t delta = (int64_t)(fileTime - lastTimestamp);
+	lastTimestamp = fileTime;
+
+	return delta;
+}
+
+void Logger::flushOutputs()
+{
+	// One console write per batch instead of one std::endl per message
+	if (logToConsole)
+		console.flush();
+
+	// No flush needed for the file, the mapping is written back by maintain() and the OS
+	if (logToFile)
+		fileSink.maintain();
 }
@@ -6,21 +6,184 @@
 
 #pragma once
 
-enum logLevel {
-	LOG_LVL_ERR = 0,
-	LOG_LVL_WRN = 1,
-	LOG_LVL_INFO = 2,
-	LOG_LVL_DEBUG = 3,
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LogConsole.h"
+#include "LogFileSink.h"
+#include "LogFormat.h"
+
+// OF_LOG calls above this level are compiled out completely, arguments included, Release builds drop LOG_LVL_DEBUG.
+// Plain logOut calls are only skipped at runtime, their arguments are still evaluated
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LVL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LVL_DEBUG
+#endif
+#endif
+
+// What logOut does when the calling thread's ring buffer is full
+enum logOverflowPolicy {
+	LOG_OVERFLOW_DROP = 0,	// Discard the record and count it, the caller never waits
+	LOG_OVERFLOW_BLOCK = 1,	// Yield until the writer thread has freed a slot
+};
+
+struct LoggerSettings
+{
+	bool logToConsole = true;
+	logConsoleBackend consoleBackend = LOG_CONSOLE_ANSI;
+	bool logToFile = false;
+	const char* logFileName = "OpenFlight.log";
+
+	// The log file is written through a memory mapped segment of this size, when it is full
+	// logging continues in OpenFlight.1.log, OpenFlight.2.log etc
+	size_t logSegmentSize = 16 * 1024 * 1024;
+	unsigned int logSyncIntervalMs = 1000;
+
+	// Most verbose level written to each output, checked before any formatting happens
+	logLevel consoleLevel = LOG_LVL_DEBUG;
+	logLevel fileLevel = LOG_LVL_DEBUG;
+
+	// Write the log file in the compact binary format (see LogFormat.h), decode it with LogDecoder.
+	// Calls made through OF_LOG only store their site id and raw arguments, formatting is skipped entirely
+	bool binaryFile = false;
+
+	// When async is set logOut only copies the message into a per thread ring buffer
+	// and a background writer thread does the actual console/file output in batches
+	bool async = true;
+	logOverflowPolicy overflowPolicy = LOG_OVERFLOW_DROP;
 };
 
+struct LoggerStats
+{
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t blocked;
+};
+
+// A single logging call site, registered with the logger the first time it is hit.
+// Declared by the OF_LOG macro, not meant to be created by hand
+struct LogSite
+{
+	logLevel lvl;
+	const char* file;
+	int line;
+	const char* fmt;
+	std::atomic<uint32_t> id;
+
+	// Filled in when the site registers, the argument types of a call site never change
+	uint8_t argCount;
+	uint8_t argTypes[LOG_MAX_ARGS];
+};
+
+// Logs through a static call site so binary logs only need to store the site id and arguments e.g.
+// OF_LOG(logger, LOG_LVL_INFO, "Loaded {} in {} ms", fileName, time);
+#define OF_LOG(logger, lvl, fmt, ...) \
+	do { \
+		if ((lvl) <= LOG_MIN_LEVEL) \
+		{ \
+			static LogSite logSite_ = { lvl, __FILE__, __LINE__, fmt, { 0 }, 0, { 0 } }; \
+			(logger).logOut(logSite_, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+struct LogRecord;
+struct LogRing;
+
 class Logger
 {
 public:
-	bool initializeLogging();
+	Logger();
+	~Logger();
+
+	bool initializeLogging(const LoggerSettings& loggerSettings = LoggerSettings());
 	void cleanup();
-	void logOut(logLevel lvl, const char* msg);
+
+	void logOut(logLevel lvl, const char* msg)
+	{
+		if (lvl > LOG_MIN_LEVEL || lvl > maxLevel)
+			return;
+
+		logMessage(lvl, 0, msg, nullptr, 0);
+	}
+
+	// Formatted logging, every {} in fmt is replaced by the next argument e.g.
+	// logOut(LOG_LVL_INFO, "Loaded {} ({} bytes)", fileName, size)
+	// Formatting happens straight into the ring buffer (or a thread local buffer) so it never allocates
+	template<typename... Args>
+	void logOut(logLevel lvl, const char* fmt, const Args&... args)
+	{
+		if (lvl > LOG_MIN_LEVEL || lvl > maxLevel)
+			return;
+
+		const LogArg logArgs[] = { LogArg(args)... };
+		logMessage(lvl, 0, fmt, logArgs, sizeof...(Args));
+	}
+
+	template<typename... Args>
+	void logOut(LogSite& site, const Args&... args)
+	{
+		if (site.lvl > LOG_MIN_LEVEL || site.lvl > maxLevel)
+			return;
+
+		const LogArg logArgs[] = { LogArg(), LogArg(args)... };
+
+		uint32_t siteId = site.id.load(std::memory_order_acquire);
+		if (siteId == 0)
+			siteId = registerSite(site, logArgs + 1, sizeof...(Args));
+
+		logMessage(site.lvl, siteId, site.fmt, logArgs + 1, sizeof...(Args));
+	}
+
+	LoggerStats getStats() const;
+
+	static uint32_t registerSite(LogSite& site, const LogArg* args, size_t argCount);
 
 private:
 	bool logToFile;
 	bool logToConsole;
+	int maxLevel;	// Most verbose level any enabled output accepts, -1 when nothing is enabled
+
+	LoggerSettings settings;
+	LogConsole console;
+	LogFileSink fileSink;
+
+	// Async backend
+	std::vector<std::unique_ptr<LogRing>> rings;
+	std::mutex ringMutex;
+	std::mutex outputMutex;
+	std::thread writerThread;
+	std::atomic<bool> writerRunning;
+	std::condition_variable writerWake;
+	std::mutex writerWakeMutex;
+	std::atomic<uint32_t> generation;
+	std::atomic<bool> closed;	// Set by cleanup before the final drain, producers fall back to synchronous output
+
+	// Binary file state, only touched with outputMutex held
+	std::vector<bool> sitesWritten;
+	uint64_t lastTimestamp;		// Of the last chunk, in LOG_BINARY_TICKS_PER_SECOND since startTimestamp
+	uint64_t startTimestamp;
+
+	std::atomic<uint64_t> writtenCount;
+	std::atomic<uint64_t> droppedCount;
+	std::atomic<uint64_t> blockedCount;
+
+	LogRing* getThreadRing();
+	void logMessage(logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount);
+	bool pushRecord(logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount);
+	void fillRecord(LogRecord& record, logLevel lvl, uint32_t siteId, const char* fmt, const LogArg* args, size_t argCount);
+	void writerLoop();
+	size_t drainRings(std::vector<LogRecord>& batch);
+	void writeRecord(const LogRecord& record);
+	void writeOut(logLevel lvl, const char* msg, size_t length, uint64_t timestamp);
+	void reserveFile(size_t length);
+	void writeFileHeader();
+	int64_t fileTimeDelta(uint64_t timestamp);
+	void flushOutputs();
 };
\ No newline at end of file
@@ -4,6 +4,7 @@
 * Main.cpp
 */
 
+#include <cstring>
 #include <iostream>
 
 #include <glad/glad.h>
@@ -12,12 +13,26 @@
 // TODO: Switch all std output to custom logger for writing to files and outputting
 #include "Logger.h"
 #include "Types.h"
+#include "Benchmark.h"
+#include "FileManager.h"
+#include "GLDebug.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
 #include "Renderer.h"
+#include "RenderThread.h"
+#include "ShaderManager.h"
 
 // -- SETTINGS --
 const unsigned int WIDTH = 1280;
 const unsigned int HEIGHT = 720;
 const char* TITLE = "OpenFlight";
+
+// Driver messages through GL_KHR_debug, synchronous in debug builds so they point at the call that caused them
+#ifdef NDEBUG
+const debugOutputMode DEBUG_OUTPUT = DEBUG_OUTPUT_OFF;
+#else
+const debugOutputMode DEBUG_OUTPUT = DEBUG_OUTPUT_SYNC;
+#endif
 // -- END SETTINGS --
 
 // -- FORWARD DECLARATIONS --
@@ -27,34 +42,62 @@ void processInput(GLFWwindow* window);
 
 // -- SYSTEMS --
 Logger logger;
+FileManager fileManager;
+JobSystem jobSystem;
+GLDebug glDebug;
+GLStateCache stateCache;
+ShaderManager shaderManager;
 Renderer mainRenderer;
+RenderThread renderThread;
 // -- END SYSTEMS --
+
+// Set by framebuffer_size_callback on the main thread, the render thread gets it in the next command list
+int viewportWidth = WIDTH;
+int viewportHeight = HEIGHT;
+bool viewportChanged = false;
 	
-int main()
+int main(int argc, char** argv)
 {
 	// -- SETUP --
 
 	// Logging system setup
 	if (!logger.initializeLogging())
 	{
-		logger.logOut(LOG_LVL_ERR, "Failed to initialize logger. Exiting...");
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize logger. Exiting...");
+		return -1;
+	}
+
+	if (!fileManager.init(&logger))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize file manager. Exiting...");
+		return -1;
+	}
+
+	// Workers for CPU culling, one per hardware thread besides this one
+	if (!jobSystem.init(&logger))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize job system. Exiting...");
 		return -1;
 	}
 
+	// Packed release assets, loose files are used for anything not in it
+	fileManager.mountArchive("OpenFlight.ofpk");
+
 	if (!glfwInit())
 	{
-		logger.logOut(LOG_LVL_ERR, "Failed to initialize GLFW. Exiting...");
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize GLFW. Exiting...");
 		return -1;
 	}
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, DEBUG_OUTPUT != DEBUG_OUTPUT_OFF);
 	
 	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, NULL, NULL);
 	if (!window)
 	{
-		logger.logOut(LOG_LVL_ERR, "Failed to create GLFW window. Exiting...");
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to create GLFW window. Exiting...");
 		glfwTerminate();
 		return -1;
 	}
@@ -63,14 +106,32 @@ int main()
 
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
-		logger.logOut(LOG_LVL_ERR, "Failed to initialize GLAD. Exiting...");
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize GLAD. Exiting...");
+		return -1;
+	}
+
+	if (!glDebug.init(&logger, DEBUG_OUTPUT))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize GL debug output. Exiting...");
+		return -1;
+	}
+
+	if (!stateCache.init(&logger))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize GL state cache. Exiting...");
+		return -1;
+	}
+
+	if (!shaderManager.init(&logger, &fileManager, &stateCache))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize shader manager. Exiting...");
 		return -1;
 	}
 
 	// Initialize renderer
-	if (!mainRenderer.init(logger))
+	if (!mainRenderer.init(&logger, &shaderManager, &stateCache, &jobSystem))
 	{
-		logger.logOut(LOG_LVL_ERR, "Failed to initialize renderer. Exiting...");
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to initialize renderer. Exiting...");
 		return -1;
 	}
 
@@ -78,22 +139,20 @@ int main()
 
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	stateCache.enable(GL_DEPTH_TEST);
+	stateCache.setDepthFunc(GL_LESS);
 
 	const GLubyte* renderer = glGetString(GL_RENDERER);
 	const GLubyte* version = glGetString(GL_VERSION);
 	const GLubyte* glslVersion = glGetString(GL_SHADING_LANGUAGE_VERSION);
 
-	logger.logOut(LOG_LVL_INFO, "Renderer, OpenGL version, GLSL Version:");
-
-	std::cout << renderer << std::endl;
-	std::cout << version << std::endl;
-	std::cout << glslVersion << std::endl;
+	OF_LOG(logger, LOG_LVL_INFO, "Renderer: {}", renderer);
+	OF_LOG(logger, LOG_LVL_INFO, "OpenGL version: {}", version);
+	OF_LOG(logger, LOG_LVL_INFO, "GLSL version: {}", glslVersion);
 
 	// -- END SETUP --
 
-	logger.logOut(LOG_LVL_INFO, "Setup succeeded, starting...");
+	OF_LOG(logger, LOG_LVL_INFO, "Setup succeeded, starting...");
 
 	// -- SETUP GRAPHICS PIPELINE --
 	float vertices[] = {
@@ -102,26 +161,105 @@ int main()
 		 0.0f,  0.5f, 0.0f
 	};
 
+	uint32_t indices[] = { 0, 1, 2 };
+
+	VertexLayout layout;
+	layout.components[VERTEX_POSITION] = 3;
+
 	// -- END GRAPHICS PIPELINE SETUP -- 
 
-	mainRenderer.setup(vertices);
+	mainRenderer.setup(layout, vertices, 3, indices, 3);
+
+	// --benchmark-instances measures instanced against per object drawing and exits, --benchmark-culling measures
+	// CPU frustum culling throughput and exits, --benchmark-logging measures logOut latency under contention and exits,
+	// --benchmark-log-format measures formatted logOut cost with stripped, disabled and live levels and exits,
+	// --benchmark-console measures console backend throughput and exits, --benchmark-read measures mapped against
+	// buffered file reads and exits
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark-instances") == 0)
+		{
+			runInstancingBenchmark(&logger, &mainRenderer, &shaderManager, window);
+			glfwSetWindowShouldClose(window, true);
+		}
+		else if (strcmp(argv[i], "--benchmark-culling") == 0)
+		{
+			runCullingBenchmark(&logger);
+			glfwSetWindowShouldClose(window, true);
+		}
+		else if (strcmp(argv[i], "--benchmark-logging") == 0)
+		{
+			runLoggingBenchmark(&logger);
+			glfwSetWindowShouldClose(window, true);
+		}
+		else if (strcmp(argv[i], "--benchmark-log-format") == 0)
+		{
+			runLogFormatBenchmark(&logger);
+			glfwSetWindowShouldClose(window, true);
+		}
+		else if (strcmp(argv[i], "--benchmark-console") == 0)
+		{
+			runConsoleBenchmark(&logger);
+			glfwSetWindowShouldClose(window, true);
+		}
+		else if (strcmp(argv[i], "--benchmark-read") == 0)
+		{
+			runReadBenchmark(&logger);
+			glfwSetWindowShouldClose(window, true);
+		}
+	}
+
+	// From here on the GL context belongs to the render thread, file polling, shader reloads and the swap happen there.
+	// So does the job system, the main thread must not call parallelFor again
+	if (!renderThread.init(&logger, window, &mainRenderer, &shaderManager, &stateCache, &fileManager))
+	{
+		OF_LOG(logger, LOG_LVL_ERR, "Failed to start render thread. Exiting...");
+		return -1;
+	}
 
 	// -- MAIN GAME LOOP --
 	while (!glfwWindowShouldClose(window))
 	{
 		processInput(window);
 
-		mainRenderer.clearScreen(0.5f, 0.5f, 0.5f, 1.0f);
+		// Recorded while the render thread draws the previous frame
+		RenderCommandList& commands = renderThread.beginFrame();
+
+		if (viewportChanged)
+		{
+			commands.setViewport(0, 0, viewportWidth, viewportHeight);
+			viewportChanged = false;
+		}
+
+		commands.setClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 
-		mainRenderer.render();
+		renderThread.submitFrame();
 
 		glfwPollEvents();
-		glfwSwapBuffers(window);
 	}
 	// -- END MAIN GAME LOOP --
 
+	// The context is current on this thread again after this
+	renderThread.cleanup();
+
+	// Render time is the CPU cost of submitting each frame, compare builds with OPENFLIGHT_GL_CHECKS on and off
+	RenderThreadStats frameStats = renderThread.getStats();
+	if (frameStats.frames > 0)
+	{
+		OF_LOG(logger, LOG_LVL_INFO, "Average render time {} ms over {} frames (GL error checks {}, debug output {})",
+			frameStats.renderMs, frameStats.frames, OPENFLIGHT_GL_CHECKS ? "on" : "off", glDebug.getMode() == DEBUG_OUTPUT_OFF ? "off" : "on");
+		OF_LOG(logger, LOG_LVL_INFO, "Per frame: main thread {} ms CPU, {} ms waiting; render thread {} ms CPU, {} ms waiting, {} ms swapping; latency {} ms, worst {} ms",
+			frameStats.mainCpuMs, frameStats.mainWaitMs, frameStats.renderCpuMs, frameStats.renderWaitMs, frameStats.swapMs,
+			frameStats.latencyMs, frameStats.maxLatencyMs);
+	}
+
 	// After the main loop is exited cleanup the logger and close GLFW
 	mainRenderer.cleanup();
+	shaderManager.cleanup();
+	stateCache.cleanup();
+	glDebug.cleanup();
+	fileManager.cleanup();
+	jobSystem.cleanup();
 	logger.cleanup();
 	glfwTerminate();
 
@@ -131,7 +269,9 @@ int main()
 // Function to resize the viewport when the user changes the window size
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	viewportWidth = width;
+	viewportHeight = height;
+	viewportChanged = true;
 }
 
 // Simple input processing, should be handed off to another class for handling later, just temp
@@ -0,0 +1,380 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* MeshManager.cpp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "MeshManager.h"
+#include "GLDebug.h"
+
+uint32_t VertexLayout::getStride() const
+{
+	uint32_t stride = 0;
+	for (uint8_t count : components)
+		stride += count * (uint32_t)sizeof(float);
+
+	return stride;
+}
+
+bool VertexLayout::operator==(const VertexLayout& other) const
+{
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+	{
+		if (components[i] != other.components[i])
+			return false;
+	}
+
+	return interleaved == other.interleaved;
+}
+
+void RangeAllocator::init(uint32_t rangeCapacity)
+{
+	capacity = rangeCapacity;
+	used = 0;
+	freeRanges.clear();
+	if (capacity > 0)
+		freeRanges[0] = capacity;
+}
+
+bool RangeAllocator::allocate(uint32_t size, uint32_t& offset)
+{
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->second < size)
+			continue;
+
+		offset = it->first;
+		uint32_t remaining = it->second - size;
+		freeRanges.erase(it);
+		if (remaining > 0)
+			freeRanges[offset + size] = remaining;
+
+		used += size;
+		return true;
+	}
+
+	return false;
+}
+
+void RangeAllocator::release(uint32_t offset, uint32_t size)
+{
+	used -= size;
+
+	auto next = freeRanges.lower_bound(offset);
+
+	// Merge with the free range right after, then with the one right before
+	if (next != freeRanges.end() && offset + size == next->first)
+	{
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+
+	if (next != freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			return;
+		}
+	}
+
+	freeRanges[offset] = size;
+}
+
+uint32_t RangeAllocator::getLargestFree() const
+{
+	uint32_t largest = 0;
+	for (const auto& range : freeRanges)
+		largest = std::max(largest, range.second);
+
+	return largest;
+}
+
+MeshManager::MeshManager()
+	: logger(nullptr), stateCache(nullptr), bytesUploaded(0), uploadMs(0.0)
+{
+}
+
+bool MeshManager::init(Logger* primaryLogger, GLStateCache* primaryStateCache)
+{
+	logger = primaryLogger;
+	stateCache = primaryStateCache;
+
+	return true;
+}
+
+void MeshManager::cleanup()
+{
+	for (MeshArena& arena : arenas)
+	{
+		stateCache->deleteVertexArray(arena.vertexArray);
+		stateCache->deleteBuffer(arena.vertexBuffer);
+		stateCache->deleteBuffer(arena.indexBuffer);
+	}
+
+	arenas.clear();
+	meshes.clear();
+	freeHandles.clear();
+}
+
+MeshHandle MeshManager::createMesh(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+{
+	if (layout.components[VERTEX_POSITION] == 0 || vertexCount == 0 || indexCount == 0)
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Meshes need positions, vertices and indices");
+		return INVALID_MESH;
+	}
+
+	Mesh mesh;
+	mesh.vertexCount = vertexCount;
+	mesh.indexCount = indexCount;
+
+	// First arena of the same layout with room for both, otherwise a new one
+	bool allocated = false;
+	for (uint32_t i = 0; i < arenas.size() && !allocated; i++)
+	{
+		MeshArena& arena = arenas[i];
+		if (!(arena.layout == layout) || !arena.vertices.allocate(vertexCount, mesh.baseVertex))
+			continue;
+
+		if (!arena.indices.allocate(indexCount, mesh.firstIndex))
+		{
+			arena.vertices.release(mesh.baseVertex, vertexCount);
+			continue;
+		}
+
+		mesh.arena = i;
+		allocated = true;
+	}
+
+	if (!allocated)
+	{
+		if (!createArena(layout, std::max((uint32_t)ARENA_VERTICES, vertexCount), std::max((uint32_t)ARENA_INDICES, indexCount)))
+			return INVALID_MESH;
+
+		mesh.arena = (uint32_t)arenas.size() - 1;
+		arenas.back().vertices.allocate(vertexCount, mesh.baseVertex);
+		arenas.back().indices.allocate(indexCount, mesh.firstIndex);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Copy targets, the element buffer binding belongs to whatever VAO is bound
+	const MeshArena& arena = arenas[mesh.arena];
+	uploadVertices(arena, vertices, mesh.baseVertex, vertexCount);
+
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)mesh.firstIndex * sizeof(uint32_t), (GLsizeiptr)indexCount * sizeof(uint32_t), indices);
+	glCheckError();
+
+	uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	bytesUploaded += (uint64_t)vertexCount * layout.getStride() + (uint64_t)indexCount * sizeof(uint32_t);
+
+	computeBounds(layout, vertices, vertexCount, mesh.bounds);
+	mesh.live = true;
+
+	MeshHandle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		meshes[handle] = mesh;
+	}
+	else
+	{
+		handle = (MeshHandle)meshes.size();
+		meshes.push_back(mesh);
+	}
+
+	return handle;
+}
+
+void MeshManager::computeBounds(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, float* bounds)
+{
+	// Positions come first in both layouts, missing components are 0
+	uint32_t components = std::min((uint32_t)layout.components[VERTEX_POSITION], 3u);
+	uint32_t stride = layout.interleaved ? layout.getStride() / sizeof(float) : layout.components[VERTEX_POSITION];
+
+	// Centred on the bounding box, not the tightest sphere but close enough for culling
+	float minimum[3] = { 0.0f, 0.0f, 0.0f };
+	float maximum[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t c = 0; c < components; c++)
+	{
+		minimum[c] = maximum[c] = vertices[c];
+		for (uint32_t i = 1; i < vertexCount; i++)
+		{
+			minimum[c] = std::min(minimum[c], vertices[i * stride + c]);
+			maximum[c] = std::max(maximum[c], vertices[i * stride + c]);
+		}
+	}
+
+	for (uint32_t c = 0; c < 3; c++)
+		bounds[c] = (minimum[c] + maximum[c]) * 0.5f;
+
+	float radiusSquared = 0.0f;
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		float distanceSquared = 0.0f;
+		for (uint32_t c = 0; c < components; c++)
+		{
+			float d = vertices[i * stride + c] - bounds[c];
+			distanceSquared += d * d;
+		}
+		radiusSquared = std::max(radiusSquared, distanceSquared);
+	}
+
+	bounds[3] = std::sqrt(radiusSquared);
+}
+
+void MeshManager::uploadVertices(const MeshArena& arena, const float* vertices, uint32_t baseVertex, uint32_t vertexCount)
+{
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBuffer);
+
+	if (arena.layout.interleaved)
+	{
+		uint32_t stride = arena.layout.getStride();
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)baseVertex * stride, (GLsizeiptr)vertexCount * stride, vertices);
+		glCheckError();
+		return;
+	}
+
+	// Each attribute has its own section of the arena, capacity vertices long
+	GLintptr section = 0;
+	uint32_t capacity = arena.vertices.getCapacity();
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+	{
+		uint32_t size = arena.layout.components[i] * (uint32_t)sizeof(float);
+		if (size == 0)
+			continue;
+
+		glBufferSubData(GL_COPY_WRITE_BUFFER, section + (GLintptr)baseVertex * size, (GLsizeiptr)vertexCount * size, vertices);
+		glCheckError();
+
+		vertices += (size_t)vertexCount * arena.layout.components[i];
+		section += (GLintptr)capacity * size;
+	}
+}
+
+void MeshManager::destroyMesh(MeshHandle handle)
+{
+	if (handle >= meshes.size() || !meshes[handle].live)
+		return;
+
+	Mesh& mesh = meshes[handle];
+	arenas[mesh.arena].vertices.release(mesh.baseVertex, mesh.vertexCount);
+	arenas[mesh.arena].indices.release(mesh.firstIndex, mesh.indexCount);
+
+	mesh.live = false;
+	freeHandles.push_back(handle);
+}
+
+bool MeshManager::getDraw(MeshHandle handle, MeshDraw& draw) const
+{
+	if (handle >= meshes.size() || !meshes[handle].live)
+		return false;
+
+	const Mesh& mesh = meshes[handle];
+	draw.vertexArray = arenas[mesh.arena].vertexArray;
+	draw.firstIndex = mesh.firstIndex;
+	draw.indexCount = mesh.indexCount;
+	draw.baseVertex = (int32_t)mesh.baseVertex;
+	for (uint32_t i = 0; i < 4; i++)
+		draw.bounds[i] = mesh.bounds[i];
+
+	return true;
+}
+
+MeshStats MeshManager::getStats() const
+{
+	MeshStats stats = MeshStats();
+	stats.meshes = (uint32_t)(meshes.size() - freeHandles.size());
+	stats.arenas = (uint32_t)arenas.size();
+	stats.bytesUploaded = bytesUploaded;
+	stats.uploadMs = uploadMs;
+
+	uint64_t freeBytes = 0;
+	uint64_t largestFree = 0;	// Summed over the arenas
+	for (const MeshArena& arena : arenas)
+	{
+		uint32_t stride = arena.layout.getStride();
+		stats.vertexBytes += (uint64_t)arena.vertices.getCapacity() * stride;
+		stats.vertexBytesUsed += (uint64_t)arena.vertices.getUsed() * stride;
+		stats.indexBytes += (uint64_t)arena.indices.getCapacity() * sizeof(uint32_t);
+		stats.indexBytesUsed += (uint64_t)arena.indices.getUsed() * sizeof(uint32_t);
+		stats.freeBlocks += arena.vertices.getFreeBlocks() + arena.indices.getFreeBlocks();
+
+		freeBytes += (uint64_t)(arena.vertices.getCapacity() - arena.vertices.getUsed()) * stride;
+		largestFree += (uint64_t)arena.vertices.getLargestFree() * stride;
+	}
+
+	// Of the vertex space, that is where most of the memory goes. Each arena counts its largest hole,
+	// free space split over several arenas is not fragmentation
+	stats.fragmentation = freeBytes > 0 ? 1.0 - (double)largestFree / (double)freeBytes : 0.0;
+
+	return stats;
+}
+
+bool MeshManager::createArena(const VertexLayout& layout, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	MeshArena arena;
+	arena.layout = layout;
+	arena.vertices.init(vertexCapacity);
+	arena.indices.init(indexCapacity);
+
+	uint32_t stride = layout.getStride();
+
+	glGenBuffers(1, &arena.vertexBuffer);
+	glGenBuffers(1, &arena.indexBuffer);
+	glGenVertexArrays(1, &arena.vertexArray);
+
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)vertexCapacity * stride, NULL, GL_STATIC_DRAW);
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)indexCapacity * sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+
+	if (glGetError() == GL_OUT_OF_MEMORY)
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Out of memory creating a mesh arena of {} vertices", vertexCapacity);
+		stateCache->deleteBuffer(arena.vertexBuffer);
+		stateCache->deleteBuffer(arena.indexBuffer);
+		stateCache->deleteVertexArray(arena.vertexArray);
+		return false;
+	}
+
+	// The VAO keeps the attribute pointers and the index buffer, every mesh of the arena draws through it
+	stateCache->bindVertexArray(arena.vertexArray);
+	stateCache->bindBuffer(GL_ARRAY_BUFFER, arena.vertexBuffer);
+	stateCache->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBuffer);
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+	{
+		uint32_t size = layout.components[i] * (uint32_t)sizeof(float);
+		if (size == 0)
+			continue;
+
+		glEnableVertexAttribArray(i);
+		if (layout.interleaved)
+		{
+			glVertexAttribPointer(i, layout.components[i], GL_FLOAT, GL_FALSE, (GLsizei)stride, (const void*)offset);
+			offset += size;
+		}
+		else
+		{
+			glVertexAttribPointer(i, layout.components[i], GL_FLOAT, GL_FALSE, (GLsizei)size, (const void*)offset);
+			offset += (size_t)vertexCapacity * size;
+		}
+	}
+	glCheckError();
+
+	arenas.push_back(arena);
+
+	OF_LOG(*logger, LOG_LVL_DEBUG, "Created mesh arena {} ({} vertices, {} indices, {} byte stride)", arenas.size() - 1, vertexCapacity, indexCapacity, stride);
+
+	return true;
+}
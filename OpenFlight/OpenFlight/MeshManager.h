@@ -0,0 +1,146 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* MeshManager.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "Logger.h"
+
+// Index of a mesh in the mesh manager
+typedef uint32_t MeshHandle;
+const MeshHandle INVALID_MESH = 0xFFFFFFFF;
+
+// Vertex attributes, each one is bound to the attribute location of the same number
+enum vertexAttribute
+{
+	VERTEX_POSITION,
+	VERTEX_NORMAL,
+	VERTEX_UV,
+	VERTEX_COLOR,
+	VERTEX_ATTRIBUTE_COUNT,
+};
+
+// Float components per attribute, 0 for attributes the mesh does not have. Interleaved vertices hold every
+// attribute of one vertex together, otherwise (SoA) each attribute comes as its own array one after the other
+struct VertexLayout
+{
+	uint8_t components[VERTEX_ATTRIBUTE_COUNT] = {};
+	bool interleaved = true;
+
+	uint32_t getStride() const;
+	bool operator==(const VertexLayout& other) const;
+};
+
+// Where a mesh lives, enough to draw it with glDrawElementsBaseVertex
+struct MeshDraw
+{
+	GLuint vertexArray;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t baseVertex;
+	float bounds[4];	// Bounding sphere of the positions, centre and radius, for culling
+};
+
+struct MeshStats
+{
+	uint32_t meshes;
+	uint32_t arenas;
+	uint64_t vertexBytes;		// Capacity of every vertex arena
+	uint64_t vertexBytesUsed;
+	uint64_t indexBytes;
+	uint64_t indexBytesUsed;
+	uint32_t freeBlocks;		// Holes left by destroyed meshes, plus the unused end of each arena
+	double fragmentation;		// 1 - largest free block / free space, 0 when all free space is in one piece
+	uint64_t bytesUploaded;
+	double uploadMs;			// Main thread time handing data to the driver, bytesUploaded / uploadMs is the throughput
+};
+
+// First fit allocator of ranges inside a fixed size block, freed ranges are merged with their neighbours
+class RangeAllocator
+{
+public:
+	void init(uint32_t rangeCapacity);
+
+	bool allocate(uint32_t size, uint32_t& offset);
+	void release(uint32_t offset, uint32_t size);
+
+	uint32_t getCapacity() const { return capacity; }
+	uint32_t getUsed() const { return used; }
+	uint32_t getLargestFree() const;
+	uint32_t getFreeBlocks() const { return (uint32_t)freeRanges.size(); }
+
+private:
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+	std::map<uint32_t, uint32_t> freeRanges;	// Offset to size
+};
+
+// Keeps many meshes in a few large buffers. Meshes with the same layout share an arena, one VBO and one index
+// buffer with a single VAO pointing at them, and are told apart by their base vertex and first index, so
+// drawing one mesh after another never rebinds anything.
+class MeshManager
+{
+public:
+	MeshManager();
+
+	bool init(Logger* primaryLogger, GLStateCache* primaryStateCache);
+	void cleanup();
+
+	// vertices holds vertexCount vertices laid out as described by layout, indices are relative to the mesh
+	MeshHandle createMesh(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+	void destroyMesh(MeshHandle handle);
+
+	bool getDraw(MeshHandle handle, MeshDraw& draw) const;
+
+	MeshStats getStats() const;
+
+	// Vertices and indices per arena, meshes bigger than that get an arena of their own
+	static const uint32_t ARENA_VERTICES = 256 * 1024;
+	static const uint32_t ARENA_INDICES = 1024 * 1024;
+
+private:
+	struct MeshArena
+	{
+		VertexLayout layout;
+		GLuint vertexBuffer = 0;
+		GLuint indexBuffer = 0;
+		GLuint vertexArray = 0;
+		RangeAllocator vertices;
+		RangeAllocator indices;
+	};
+
+	struct Mesh
+	{
+		bool live = false;
+		uint32_t arena = 0;
+		uint32_t baseVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float bounds[4] = {};
+	};
+
+	// Systems
+	Logger* logger;
+	GLStateCache* stateCache;
+
+	std::vector<MeshArena> arenas;
+	std::vector<Mesh> meshes;
+	std::vector<MeshHandle> freeHandles;
+
+	uint64_t bytesUploaded;
+	double uploadMs;
+
+	bool createArena(const VertexLayout& layout, uint32_t vertexCapacity, uint32_t indexCapacity);
+	static void computeBounds(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, float* bounds);
+	void uploadVertices(const MeshArena& arena, const float* vertices, uint32_t baseVertex, uint32_t vertexCount);
+};
\ No newline at end of file
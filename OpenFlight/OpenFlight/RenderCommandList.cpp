@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderCommandList.cpp
+*/
+
+#include "RenderCommandList.h"
+
+void RenderCommandList::reset()
+{
+	commands.clear();
+	matrices.clear();
+	instances.clear();
+}
+
+RenderCommand& RenderCommandList::push(renderCommandType type)
+{
+	commands.emplace_back();
+
+	RenderCommand& command = commands.back();
+	command.type = type;
+	command.shader = INVALID_SHADER;
+	command.mesh = 0;
+	command.material = 0;
+	command.first = 0;
+	command.count = 0;
+	command.values[0] = command.values[1] = command.values[2] = command.values[3] = 0.0f;
+
+	return command;
+}
+
+void RenderCommandList::setClearColor(float r, float g, float b, float a)
+{
+	RenderCommand& command = push(RENDER_COMMAND_CLEAR_COLOR);
+	command.values[0] = r;
+	command.values[1] = g;
+	command.values[2] = b;
+	command.values[3] = a;
+}
+
+void RenderCommandList::setViewport(int x, int y, int width, int height)
+{
+	RenderCommand& command = push(RENDER_COMMAND_VIEWPORT);
+	command.values[0] = (float)x;
+	command.values[1] = (float)y;
+	command.values[2] = (float)width;
+	command.values[3] = (float)height;
+}
+
+void RenderCommandList::setViewProjection(const float* matrix)
+{
+	RenderCommand& command = push(RENDER_COMMAND_VIEW_PROJECTION);
+	command.first = (uint32_t)(matrices.size() / 16);
+	matrices.insert(matrices.end(), matrix, matrix + 16);
+}
+
+void RenderCommandList::draw(ShaderHandle shader, MeshHandle mesh, MaterialHandle material, const float* transform)
+{
+	RenderCommand& command = push(RENDER_COMMAND_DRAW);
+	command.shader = shader;
+	command.mesh = mesh;
+	command.material = material;
+	command.first = (uint32_t)(matrices.size() / 16);
+	matrices.insert(matrices.end(), transform, transform + 16);
+}
+
+void RenderCommandList::drawInstances(ShaderHandle shader, MeshHandle mesh, const InstanceData* data, uint32_t count)
+{
+	if (count == 0)
+		return;
+
+	RenderCommand& command = push(RENDER_COMMAND_DRAW_INSTANCES);
+	command.shader = shader;
+	command.mesh = mesh;
+	command.first = (uint32_t)instances.size();
+	command.count = count;
+	instances.insert(instances.end(), data, data + count);
+}
@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderCommandList.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshManager.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+
+enum renderCommandType
+{
+	RENDER_COMMAND_CLEAR_COLOR,
+	RENDER_COMMAND_VIEWPORT,
+	RENDER_COMMAND_VIEW_PROJECTION,
+	RENDER_COMMAND_DRAW,
+	RENDER_COMMAND_DRAW_INSTANCES,
+};
+
+// One recorded call, only the fields its type needs are set
+struct RenderCommand
+{
+	renderCommandType type;
+	ShaderHandle shader;
+	MeshHandle mesh;
+	MaterialHandle material;
+	uint32_t first;			// Index of the first matrix or instance in the list
+	uint32_t count;			// Instances
+	float values[4];		// Clear color, or the viewport rectangle
+};
+
+// A frame of rendering recorded as handles and plain data, with no graphics API calls or objects in it, so it can be
+// built on one thread and replayed by the renderer on another. Matrices and instances are copied into the list, the
+// caller's memory can be reused as soon as a call returns. Reset keeps the capacity, a list reused every frame
+// stops allocating once it has seen the largest one.
+class RenderCommandList
+{
+public:
+	void reset();
+
+	void setClearColor(float r, float g, float b, float a);
+	void setViewport(int x, int y, int width, int height);
+	// Takes instance transforms to clip space for the instanced draws after it, see Renderer::setViewProjection
+	void setViewProjection(const float* matrix);
+
+	// One mesh through the render queue, transform is uploaded to the "model" uniform
+	void draw(ShaderHandle shader, MeshHandle mesh, MaterialHandle material, const float* transform);
+	// Instances of a mesh through the indirect renderer, see Renderer::submitIndirect
+	void drawInstances(ShaderHandle shader, MeshHandle mesh, const InstanceData* instances, uint32_t count);
+
+	const std::vector<RenderCommand>& getCommands() const { return commands; }
+	const float* getMatrix(uint32_t index) const { return &matrices[(size_t)index * 16]; }
+	const InstanceData* getInstances(uint32_t first) const { return instances.data() + first; }
+
+	uint32_t getInstanceCount() const { return (uint32_t)instances.size(); }
+
+private:
+	std::vector<RenderCommand> commands;
+	std::vector<float> matrices;
+	std::vector<InstanceData> instances;
+
+	RenderCommand& push(renderCommandType type);
+};
\ No newline at end of file
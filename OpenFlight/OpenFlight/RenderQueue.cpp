@@ -0,0 +1,246 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderQueue.cpp
+*/
+
+#include <chrono>
+#include <cstring>
+
+#include "RenderQueue.h"
+#include "GLDebug.h"
+
+// Key layout, most significant first
+//   opaque:      0 | program 12 | material 12 | VAO 15 | depth 24
+//   transparent: 1 | inverted depth 24 | program 12 | material 12 | VAO 15
+// Fields are truncated to their width, that only costs sorting quality since items keep their full data
+const uint64_t KEY_PROGRAM_MASK = 0xFFF;
+const uint64_t KEY_MATERIAL_MASK = 0xFFF;
+const uint64_t KEY_VERTEX_ARRAY_MASK = 0x7FFF;
+const uint64_t KEY_DEPTH_MASK = 0xFFFFFF;
+
+// Positive floats order the same as their bits, the top 24 of those keep the exponent and most of the mantissa
+static uint64_t depthBits(float depth)
+{
+	if (!(depth > 0.0f))
+		return 0;
+
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+
+	return (bits >> 7) & KEY_DEPTH_MASK;
+}
+
+RenderQueue::RenderQueue()
+	: logger(nullptr), shaderManager(nullptr), stateCache(nullptr), stats()
+{
+}
+
+bool RenderQueue::init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache)
+{
+	logger = primaryLogger;
+	shaderManager = primaryShaderManager;
+	stateCache = primaryStateCache;
+
+	materials.clear();
+	materials.push_back(RenderMaterial());
+
+	return true;
+}
+
+void RenderQueue::cleanup()
+{
+	materials.clear();
+	items.clear();
+	entries.clear();
+	sortScratch.clear();
+}
+
+MaterialHandle RenderQueue::addMaterial(const RenderMaterial& material)
+{
+	materials.push_back(material);
+
+	return (MaterialHandle)(materials.size() - 1);
+}
+
+void RenderQueue::submit(const DrawItem& item)
+{
+	if (item.material >= materials.size())
+	{
+		OF_LOG(*logger, LOG_LVL_WRN, "Draw submitted with unknown material {}", item.material);
+		return;
+	}
+
+	entries.push_back({ makeKey(item), (uint32_t)items.size() });
+	items.push_back(item);
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem& item) const
+{
+	uint64_t program = item.shader & KEY_PROGRAM_MASK;
+	uint64_t material = item.material & KEY_MATERIAL_MASK;
+	uint64_t vertexArray = item.vertexArray & KEY_VERTEX_ARRAY_MASK;
+	uint64_t depth = depthBits(item.depth);
+
+	if (materials[item.material].transparent)
+		return (1ULL << 63) | ((KEY_DEPTH_MASK - depth) << 39) | (program << 27) | (material << 15) | vertexArray;
+
+	return (program << 51) | (material << 39) | (vertexArray << 24) | depth;
+}
+
+void RenderQueue::sortEntries()
+{
+	// LSD radix sort, 8 bits per pass. Bytes that are the same in every key (often the high depth bits or the
+	// program when there is only one) are skipped entirely
+	size_t count = entries.size();
+	sortScratch.resize(count);
+
+	SortEntry* source = entries.data();
+	SortEntry* destination = sortScratch.data();
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+			offsets[(source[i].key >> shift) & 0xFF]++;
+
+		if (offsets[(source[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		size_t total = 0;
+		for (size_t& offset : offsets)
+		{
+			size_t bucket = offset;
+			offset = total;
+			total += bucket;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+		std::swap(source, destination);
+	}
+
+	if (source != entries.data())
+		entries.swap(sortScratch);
+}
+
+void RenderQueue::applyMaterial(const RenderMaterial& material)
+{
+	if (material.texture)
+		stateCache->bindTexture(0, GL_TEXTURE_2D, material.texture);
+
+	if (material.transparent)
+	{
+		stateCache->enable(GL_BLEND);
+		stateCache->setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		stateCache->setDepthMask(false);
+	}
+	else
+	{
+		stateCache->disable(GL_BLEND);
+		stateCache->setDepthMask(true);
+	}
+}
+
+void RenderQueue::bindInstances(GLuint buffer, GLintptr offset)
+{
+	stateCache->bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// A mat4 attribute is four vec4 columns, each in a location of its own
+	for (GLuint i = 0; i < 5; i++)
+	{
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + i);
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(offset + i * 4 * sizeof(float)));
+		glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 1);
+	}
+	glCheckError();
+}
+
+void RenderQueue::execute()
+{
+	stats = RenderQueueStats();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!entries.empty())
+		sortEntries();
+	stats.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	ShaderHandle shader = INVALID_SHADER;
+	GLuint program = 0;
+	MaterialHandle material = 0xFFFFFFFF;
+	GLuint vertexArray = 0xFFFFFFFF;
+
+	// Instance attributes are VAO state, so they are set up again whenever the VAO changes
+	GLuint instanceBuffer = 0;
+	GLintptr instanceOffset = 0;
+
+	for (const SortEntry& entry : entries)
+	{
+		const DrawItem& item = items[entry.item];
+
+		if (item.shader != shader)
+		{
+			// Programs still compiling have nothing to draw with
+			shader = item.shader;
+			program = shaderManager->getProgram(shader);
+			if (program)
+			{
+				stateCache->useProgram(program);
+				stats.programChanges++;
+			}
+		}
+
+		if (!program)
+			continue;
+
+		if (item.material != material)
+		{
+			material = item.material;
+			applyMaterial(materials[material]);
+			stats.materialChanges++;
+		}
+
+		if (item.vertexArray != vertexArray)
+		{
+			vertexArray = item.vertexArray;
+			stateCache->bindVertexArray(vertexArray);
+			stats.vertexArrayChanges++;
+			instanceBuffer = 0;
+		}
+
+		if (item.instanceCount > 0 && (item.instanceBuffer != instanceBuffer || item.instanceOffset != instanceOffset))
+		{
+			instanceBuffer = item.instanceBuffer;
+			instanceOffset = item.instanceOffset;
+			bindInstances(instanceBuffer, instanceOffset);
+		}
+
+		// Only reaches the driver when the transform differs from the last one this program was given
+		shaderManager->setUniformMatrix4(shader, uniformName("model"), item.transform);
+
+		const void* indexOffset = (const void*)((size_t)item.first * sizeof(uint32_t));
+		if (item.instanceCount > 0)
+		{
+			if (item.indexed)
+				glDrawElementsInstancedBaseVertex(item.mode, item.count, GL_UNSIGNED_INT, indexOffset, item.instanceCount, item.baseVertex);
+			else
+				glDrawArraysInstanced(item.mode, item.first, item.count, item.instanceCount);
+			stats.instances += (uint32_t)item.instanceCount;
+		}
+		else if (item.indexed)
+		{
+			glDrawElementsBaseVertex(item.mode, item.count, GL_UNSIGNED_INT, indexOffset, item.baseVertex);
+		}
+		else
+		{
+			glDrawArrays(item.mode, item.first, item.count);
+		}
+		glCheckError();
+
+		stats.draws++;
+	}
+
+	items.clear();
+	entries.clear();
+}
@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderQueue.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "Logger.h"
+#include "MeshManager.h"
+#include "ShaderManager.h"
+
+// Index into the queue's materials, 0 is the default opaque untextured material
+typedef uint32_t MaterialHandle;
+
+struct RenderMaterial
+{
+	GLuint texture = 0;			// Bound to unit 0, 0 for none
+	bool transparent = false;	// Alpha blended without depth writes, drawn after everything opaque
+};
+
+// Per instance attributes of instanced draws, the transform takes locations INSTANCE_ATTRIBUTE to
+// INSTANCE_ATTRIBUTE + 3 and the colour INSTANCE_ATTRIBUTE + 4, right after the mesh attributes
+struct InstanceData
+{
+	float transform[16];
+	float color[4];
+};
+
+const GLuint INSTANCE_ATTRIBUTE = VERTEX_ATTRIBUTE_COUNT;
+
+// One draw, submitted every frame it should be drawn
+struct DrawItem
+{
+	ShaderHandle shader = INVALID_SHADER;
+	GLuint vertexArray = 0;
+	MaterialHandle material = 0;
+	float depth = 0.0f;			// View space distance, opaque draws go front to back and transparent ones back to front
+	float transform[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };	// Uploaded to the "model" uniform
+
+	GLenum mode = GL_TRIANGLES;
+	bool indexed = false;		// glDrawElements with 32 bit indices from the VAO's element buffer
+	GLint first = 0;
+	GLsizei count = 0;
+	GLint baseVertex = 0;		// Added to every index, for meshes sharing one buffer
+
+	// Instanced draws read one InstanceData per instance from instanceBuffer, starting at instanceOffset
+	GLsizei instanceCount = 0;
+	GLuint instanceBuffer = 0;
+	GLintptr instanceOffset = 0;
+};
+
+// Last executed frame
+struct RenderQueueStats
+{
+	uint32_t draws;
+	uint32_t programChanges;
+	uint32_t materialChanges;
+	uint32_t vertexArrayChanges;
+	uint32_t instances;			// Drawn by instanced draws, each of those counts as one draw
+	double sortMs;
+};
+
+// Collects the draws of a frame and submits them in the order that needs the fewest state changes. Every item
+// is given a 64 bit key, opaque items sort by program, material, VAO and then depth, transparent ones after
+// them by depth first so they blend correctly. The keys are radix sorted, which is linear in the item count.
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	bool init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache);
+	void cleanup();
+
+	MaterialHandle addMaterial(const RenderMaterial& material);
+
+	void submit(const DrawItem& item);
+
+	// Sorts and draws everything submitted since the last call, then empties the queue
+	void execute();
+
+	RenderQueueStats getStats() const { return stats; }
+
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t item;
+	};
+
+	// Systems
+	Logger* logger;
+	ShaderManager* shaderManager;
+	GLStateCache* stateCache;
+
+	std::vector<RenderMaterial> materials;
+	std::vector<DrawItem> items;
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> sortScratch;
+	RenderQueueStats stats;
+
+	uint64_t makeKey(const DrawItem& item) const;
+	void sortEntries();
+	void applyMaterial(const RenderMaterial& material);
+	void bindInstances(GLuint buffer, GLintptr offset);
+};
\ No newline at end of file
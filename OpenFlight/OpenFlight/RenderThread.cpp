@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderThread.cpp
+*/
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "RenderThread.h"
+
+// CPU time the calling thread has used so far, user and kernel
+static double threadCpuMs()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0.0;
+
+	// 100 ns units
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+	return (double)(kernelTime.QuadPart + userTime.QuadPart) / 10000.0;
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+		return 0.0;
+
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+#endif
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+RenderThread::RenderThread()
+	: logger(nullptr), renderer(nullptr), shaderManager(nullptr), stateCache(nullptr), fileManager(nullptr), window(nullptr),
+	running(false), recordFrame(0), renderFrame(0), mainCpuStart(-1.0), mainFrames(0), frameCount(0),
+	mainCpuMs(0.0), renderCpuMs(0.0), mainWaitMs(0.0), renderWaitMs(0.0), renderMs(0.0), swapMs(0.0), latencyMs(0.0), maxLatencyMs(0.0)
+{
+	for (Frame& frame : frames)
+		frame.state = FRAME_FREE;
+}
+
+RenderThread::~RenderThread()
+{
+	cleanup();
+}
+
+bool RenderThread::init(Logger* primaryLogger, GLFWwindow* primaryWindow, Renderer* primaryRenderer, ShaderManager* primaryShaderManager,
+	GLStateCache* primaryStateCache, FileManager* primaryFileManager)
+{
+	logger = primaryLogger;
+	window = primaryWindow;
+	renderer = primaryRenderer;
+	shaderManager = primaryShaderManager;
+	stateCache = primaryStateCache;
+	fileManager = primaryFileManager;
+
+	// A context can only be current on one thread at a time
+	glfwMakeContextCurrent(nullptr);
+
+	running = true;
+	thread = std::thread(&RenderThread::renderLoop, this);
+
+	OF_LOG(*logger, LOG_LVL_INFO, "Rendering on its own thread, {} command lists", (uint32_t)FRAMES);
+
+	return true;
+}
+
+void RenderThread::cleanup()
+{
+	if (!thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	submitted.notify_one();
+	thread.join();
+
+	glfwMakeContextCurrent(window);
+
+	for (Frame& frame : frames)
+	{
+		frame.state = FRAME_FREE;
+		frame.commands.reset();
+	}
+}
+
+RenderCommandList& RenderThread::beginFrame()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double cpu = threadCpuMs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Everything the main thread did since the last frame began, input and simulation included
+	if (mainCpuStart >= 0.0)
+		mainCpuMs += cpu - mainCpuStart;
+	mainCpuStart = cpu;
+
+	Frame& frame = frames[recordFrame];
+	rendered.wait(lock, [&frame]() { return frame.state == FRAME_FREE; });
+	mainWaitMs += elapsedMs(start, std::chrono::steady_clock::now());
+
+	frame.state = FRAME_RECORDING;
+	frame.start = start;
+	lock.unlock();
+
+	frame.commands.reset();
+	return frame.commands;
+}
+
+void RenderThread::submitFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frames[recordFrame].state = FRAME_SUBMITTED;
+		recordFrame = (recordFrame + 1) % FRAMES;
+		mainFrames++;
+	}
+	submitted.notify_one();
+}
+
+RenderThreadStats RenderThread::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	RenderThreadStats stats = {};
+	stats.frames = frameCount;
+	if (mainFrames > 0)
+	{
+		stats.mainCpuMs = mainCpuMs / mainFrames;
+		stats.mainWaitMs = mainWaitMs / mainFrames;
+	}
+	if (frameCount > 0)
+	{
+		stats.renderCpuMs = renderCpuMs / frameCount;
+		stats.renderWaitMs = renderWaitMs / frameCount;
+		stats.renderMs = renderMs / frameCount;
+		stats.swapMs = swapMs / frameCount;
+		stats.latencyMs = latencyMs / frameCount;
+	}
+	stats.maxLatencyMs = maxLatencyMs;
+
+	return stats;
+}
+
+void RenderThread::renderLoop()
+{
+	glfwMakeContextCurrent(window);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		// Frames submitted before cleanup are still rendered
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+		Frame& frame = frames[renderFrame];
+		submitted.wait(lock, [this, &frame]() { return frame.state == FRAME_SUBMITTED || !running; });
+		if (frame.state != FRAME_SUBMITTED)
+			break;
+
+		frame.state = FRAME_RENDERING;
+		std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
+		lock.unlock();
+
+		double cpuStart = threadCpuMs();
+
+		renderer->execute(frame.commands);
+		renderer->render();
+
+		std::chrono::steady_clock::time_point renderEnd = std::chrono::steady_clock::now();
+
+		// Hand finished background file reads and file changes to whoever asked for them
+		fileManager->pollCompletions();
+
+		// Rebuild shaders that changed on disk, swapped in once they link
+		shaderManager->update();
+
+		std::chrono::steady_clock::time_point swapStart = std::chrono::steady_clock::now();
+		glfwSwapBuffers(window);
+		std::chrono::steady_clock::time_point swapEnd = std::chrono::steady_clock::now();
+
+		stateCache->endFrame();
+
+		double cpu = threadCpuMs() - cpuStart;
+
+		lock.lock();
+		double latency = elapsedMs(frame.start, swapEnd);
+		frameCount++;
+		renderCpuMs += cpu;
+		renderWaitMs += elapsedMs(waitStart, renderStart);
+		renderMs += elapsedMs(renderStart, renderEnd);
+		swapMs += elapsedMs(swapStart, swapEnd);
+		latencyMs += latency;
+		if (latency > maxLatencyMs)
+			maxLatencyMs = latency;
+
+		frame.state = FRAME_FREE;
+		renderFrame = (renderFrame + 1) % FRAMES;
+		rendered.notify_one();
+	}
+	lock.unlock();
+
+	glfwMakeContextCurrent(nullptr);
+}
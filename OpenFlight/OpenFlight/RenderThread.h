@@ -0,0 +1,114 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* RenderThread.h
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "FileManager.h"
+#include "GLStateCache.h"
+#include "Logger.h"
+#include "RenderCommandList.h"
+#include "Renderer.h"
+#include "ShaderManager.h"
+
+// Per frame averages over every frame rendered since init
+struct RenderThreadStats
+{
+	uint64_t frames;
+	double mainCpuMs;		// CPU time the OS charged to each thread, waits included only if they spin
+	double renderCpuMs;
+	double mainWaitMs;		// Main thread blocked because the render thread was a whole frame behind
+	double renderWaitMs;	// Render thread idle with no command list to replay
+	double renderMs;		// Replaying the command list and rendering it, without the swap
+	double swapMs;
+	double latencyMs;		// From beginFrame on the main thread to the swap of that frame returning
+	double maxLatencyMs;
+};
+
+// Owns the GL context on a thread of its own. The main thread records each frame into a command list and hands it
+// over, the render thread replays it through the renderer, runs the per frame GL work and swaps. There are two
+// lists, so the main thread records the next frame while the current one renders and only waits when it gets a
+// whole frame ahead. Everything given to init is only touched by the render thread until cleanup.
+class RenderThread
+{
+public:
+	RenderThread();
+	~RenderThread();
+
+	// The window's context has to be current on the calling thread, it is moved to the render thread
+	bool init(Logger* primaryLogger, GLFWwindow* primaryWindow, Renderer* primaryRenderer, ShaderManager* primaryShaderManager,
+		GLStateCache* primaryStateCache, FileManager* primaryFileManager);
+	// Renders the frames already submitted, stops, and makes the context current on the calling thread again
+	void cleanup();
+
+	// An empty list for the next frame, valid until submitFrame
+	RenderCommandList& beginFrame();
+	void submitFrame();
+
+	RenderThreadStats getStats();
+
+private:
+	enum frameState
+	{
+		FRAME_FREE,
+		FRAME_RECORDING,
+		FRAME_SUBMITTED,
+		FRAME_RENDERING,
+	};
+
+	struct Frame
+	{
+		RenderCommandList commands;
+		frameState state;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	static const uint32_t FRAMES = 2;
+
+	// Systems
+	Logger* logger;
+	Renderer* renderer;
+	ShaderManager* shaderManager;
+	GLStateCache* stateCache;
+	FileManager* fileManager;
+
+	GLFWwindow* window;
+	std::thread thread;
+
+	// Guards the frame states, running and the totals
+	std::mutex mutex;
+	std::condition_variable submitted;
+	std::condition_variable rendered;
+	bool running;
+
+	Frame frames[FRAMES];
+	uint32_t recordFrame;		// Next frame the main thread records into
+	uint32_t renderFrame;		// Next frame the render thread replays
+
+	// Main thread CPU time at the last beginFrame, negative before the first
+	double mainCpuStart;
+
+	// Totals, divided by the frames of their thread for the stats
+	uint64_t mainFrames;
+	uint64_t frameCount;
+	double mainCpuMs;
+	double renderCpuMs;
+	double mainWaitMs;
+	double renderWaitMs;
+	double renderMs;
+	double swapMs;
+	double latencyMs;
+	double maxLatencyMs;
+
+	void renderLoop();
+};
\ No newline at end of file
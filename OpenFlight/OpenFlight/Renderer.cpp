@@ -4,93 +4,119 @@
 * Renderer.cpp
 */
 
+#include <cstring>
+
 #include "Renderer.h"
+#include "GLDebug.h"
 
-// TODO: Add shader loader
-const char* vertexShaderSrc = "#version 330 core\n"
-"layout (location = 0) in vec3 aPos;\n"
-"void main()\n"
-"{\n"
-"   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-"}\0";
-
-const char* fragmentShaderSrc = "#version 330 core\n"
-"out vec4 FragColour;\n"
-"void main()\n"
-"{\n"
-"	FragColour = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
-"}\0";
-
-GLenum glCheckError_(const char* file, int line)
+bool Renderer::init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache, JobSystem* primaryJobSystem)
 {
-	GLenum errorCode;
-	while ((errorCode = glGetError()) != GL_NO_ERROR)
+	logger = primaryLogger;
+	shaderManager = primaryShaderManager;
+	stateCache = primaryStateCache;
+	jobSystem = primaryJobSystem;
+
+	if (!meshes.init(logger, stateCache))
 	{
-		std::string error;
-		switch (errorCode)
-		{
-		case GL_INVALID_ENUM:                  error = "INVALID_ENUM"; break;
-		case GL_INVALID_VALUE:                 error = "INVALID_VALUE"; break;
-		case GL_INVALID_OPERATION:             error = "INVALID_OPERATION"; break;
-		case GL_STACK_OVERFLOW:                error = "STACK_OVERFLOW"; break;
-		case GL_STACK_UNDERFLOW:               error = "STACK_UNDERFLOW"; break;
-		case GL_OUT_OF_MEMORY:                 error = "OUT_OF_MEMORY"; break;
-		case GL_INVALID_FRAMEBUFFER_OPERATION: error = "INVALID_FRAMEBUFFER_OPERATION"; break;
-		}
-		std::cout << error << " | " << file << " (" << line << ")" << std::endl;
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize mesh manager");
+		return false;
 	}
-	return errorCode;
-}
 
-#define glCheckError() glCheckError_(__FILE__, __LINE__) 
+	if (!queue.init(logger, shaderManager, stateCache))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize render queue");
+		return false;
+	}
 
-bool Renderer::init(Logger primaryLogger)
-{
-	logger = primaryLogger;
+	if (!stream.init(logger, stateCache, STREAM_FRAME_BYTES))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize upload ring");
+		return false;
+	}
+
+	if (!culler.init(logger, shaderManager, stateCache))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize GPU culler");
+		return false;
+	}
+
+	if (!frustumCuller.init(logger, jobSystem))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize frustum culler");
+		return false;
+	}
+
+	if (!indirect.init(logger, shaderManager, stateCache, &meshes, &culler, &frustumCuller, jobSystem))
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to initialize indirect renderer");
+		return false;
+	}
 
 	return true;
 }
 
 void Renderer::cleanup()
 {
-	glDeleteVertexArrays(1, &VAO);
-	glCheckError();
-	
-	glDeleteBuffers(1, &VBO);
-	glCheckError();
+	queue.cleanup();
+	indirect.cleanup();
 
-	glDeleteProgram(shaderProgram);
-	glCheckError();
-}
+	CullStats cullStats = culler.getStats();
+	if (culler.isSupported())
+		OF_LOG(*logger, LOG_LVL_INFO, "GPU culling: {} of {} instances visible, {} outside the frustum, {} occluded",
+			cullStats.visible, cullStats.instances, cullStats.frustumCulled, cullStats.occlusionCulled);
 
+	culler.cleanup();
 
-void Renderer::setup(float* vertices)
-{
-	// Create vertex shader
-	compileShader(VERTEX, vertexShaderSrc);
+	FrustumCullStats frustumStats = frustumCuller.getStats();
+	if (frustumStats.spheres)
+		OF_LOG(*logger, LOG_LVL_INFO, "CPU culling: {} of {} instances visible in {} ms with the {} kernel on {} threads",
+			frustumStats.visible, frustumStats.spheres, frustumStats.cullMs, frustumStats.kernel, frustumStats.threads);
 
-	if (!validateShader(vertexShader, VERTEX))
+	frustumCuller.cleanup();
+
+	for (InstanceBucket& bucket : instanceBuckets)
 	{
-		logger.logOut(LOG_LVL_ERR, "Fatal Error: An error occured while validating the vertex shader");
+		if (bucket.buffer)
+			stateCache->deleteBuffer(bucket.buffer);
 	}
+	instanceBuckets.clear();
 
-	// Create fragment shader
-	compileShader(FRAGMENT, fragmentShaderSrc);
+	MeshStats stats = meshes.getStats();
+	OF_LOG(*logger, LOG_LVL_INFO, "Meshes: {} in {} arenas, {} / {} vertex bytes, {} / {} index bytes used, fragmentation {}, {} bytes uploaded in {} ms",
+		stats.meshes, stats.arenas, stats.vertexBytesUsed, stats.vertexBytes, stats.indexBytesUsed, stats.indexBytes,
+		stats.fragmentation, stats.bytesUploaded, stats.uploadMs);
 
-	if (!validateShader(fragmentShader, FRAGMENT))
-	{
-		logger.logOut(LOG_LVL_ERR, "Fatal Error: An error occured while validating the fragment shader");
-	}
+	meshes.cleanup();
 
-	// Create shader program
-	compileProgram();
+	UploadRingStats streamStats = stream.getStats();
+	OF_LOG(*logger, LOG_LVL_INFO, "Upload ring: {} bytes streamed, peak {} bytes per frame, {} stalls ({} ms), {} overflows",
+		streamStats.totalBytes, streamStats.peakFrameBytes, streamStats.stalls, streamStats.stallMs, streamStats.overflows);
 
-	if (!validateProgram(shaderProgram))
-	{
-		logger.logOut(LOG_LVL_ERR, "Fatal Error: An error occured while compiling the shader program");
-	}
+	stream.cleanup();
+}
 
-	generateBuffers(vertices);
+
+void Renderer::setup(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+{
+	// Create shader program, the shader manager reports any errors and reloads it when the files change
+	shaderProgram = shaderManager->loadProgram("vertexShader.vert", "fragmentShader.frag");
+
+	triangleMesh = meshes.createMesh(layout, vertices, vertexCount, indices, indexCount);
+}
+
+bool Renderer::setMesh(DrawItem& item, MeshHandle mesh) const
+{
+	MeshDraw draw;
+	if (!meshes.getDraw(mesh, draw))
+		return false;
+
+	item.vertexArray = draw.vertexArray;
+	item.indexed = true;
+	item.first = (GLint)draw.firstIndex;
+	item.count = (GLsizei)draw.indexCount;
+	item.baseVertex = draw.baseVertex;
+
+	return true;
 }
 
 // This needs a refactor to include the while loop to prevent memory leaks
@@ -99,151 +125,152 @@ void Renderer::render()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glCheckError();
 
-	glUseProgram(shaderProgram);
-	glCheckError();
+	// Waits only if the GPU is more than UploadRing::FRAMES frames behind
+	stream.beginFrame();
 
-	glBindVertexArray(VAO);
-	glCheckError();
+	// The test triangle until there is a scene to submit draws
+	DrawItem triangle;
+	triangle.shader = shaderProgram;
+	if (setMesh(triangle, triangleMesh))
+		queue.submit(triangle);
 
-	glDrawArrays(GL_TRIANGLES, 0, 3);
-	glCheckError();
-	
-	glBindVertexArray(0);
-	glCheckError();
+	submitInstances();
+
+	// Programs are looked up when the queue executes, so hot reloaded ones are picked up and ones still compiling are skipped
+	queue.execute();
+	indirect.execute();
+
+	// From everything drawn this frame, for culling the next one
+	culler.buildDepthPyramid();
+
+	stream.endFrame();
 }
 
-void Renderer::clearScreen(float r, float g, float b, float a)
+InstanceBucketHandle Renderer::addInstanceBucket(MeshHandle mesh, ShaderHandle shader, MaterialHandle material)
 {
-	glClearColor(r, g, b, a);
-	glCheckError();
+	InstanceBucket bucket;
+	bucket.mesh = mesh;
+	bucket.shader = shader;
+	bucket.material = material;
+	bucket.buffer = 0;
+	bucket.capacity = 0;
+	bucket.dirty = false;
+	instanceBuckets.push_back(std::move(bucket));
+
+	return (InstanceBucketHandle)(instanceBuckets.size() - 1);
 }
 
-void Renderer::compileShader(ShaderType type, const char* src)
+void Renderer::addInstance(InstanceBucketHandle bucket, const InstanceData& instance)
 {
-	switch (type)
-	{
-	case VERTEX:
-		vertexShader = glCreateShader(GL_VERTEX_SHADER);
-
-		// Compile the source
-		glShaderSource(vertexShader, 1, &src, NULL);
-		glCheckError();
-		glCompileShader(vertexShader);
-		glCheckError();
-		break;
-	case FRAGMENT:
-		fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-
-		// Compile the source
-		glShaderSource(fragmentShader, 1, &src, NULL);
-		glCheckError();
-		glCompileShader(fragmentShader);
-		glCheckError();
-		break;
-	default:
-		logger.logOut(LOG_LVL_ERR, "Fatal Error: Shader type unkown");
-		break;
-	}
+	instanceBuckets[bucket].instances.push_back(instance);
+	instanceBuckets[bucket].dirty = true;
 }
 
-void Renderer::compileProgram()
+void Renderer::setInstances(InstanceBucketHandle bucket, const InstanceData* instances, uint32_t count)
 {
-	// Create shader program
-	shaderProgram = glCreateProgram();
-
-	glAttachShader(shaderProgram, vertexShader);
-	glCheckError();
-	glAttachShader(shaderProgram, fragmentShader);
-	glCheckError();
-	glLinkProgram(shaderProgram);
-	glCheckError();
-
-	// Delete unessecary shaders
-	glDeleteShader(vertexShader);
-	glCheckError();
-	glDeleteShader(fragmentShader);
-	glCheckError();
+	instanceBuckets[bucket].instances.assign(instances, instances + count);
+	instanceBuckets[bucket].dirty = true;
 }
 
-void Renderer::generateBuffers(float* vertices)
+void Renderer::clearInstances(InstanceBucketHandle bucket)
 {
-	// Vertex Buffers
-	glGenBuffers(1, &VBO);
-	glCheckError();
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glCheckError();
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glCheckError();
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glCheckError();
-
-	// Vertex Arrays
-	glGenVertexArrays(1, &VAO);
-	glCheckError();
-
-	glBindVertexArray(VAO);
-	glCheckError();
+	instanceBuckets[bucket].instances.clear();
+	instanceBuckets[bucket].dirty = true;
+}
 
-	glEnableVertexAttribArray(0);
-	glCheckError();
+void Renderer::submitInstances()
+{
+	for (InstanceBucket& bucket : instanceBuckets)
+	{
+		if (bucket.instances.empty())
+			continue;
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glCheckError();
+		if (bucket.dirty)
+		{
+			uploadInstances(bucket);
+			bucket.dirty = false;
+		}
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), NULL);
-	glCheckError();
+		DrawItem item;
+		item.shader = bucket.shader;
+		item.material = bucket.material;
+		if (!setMesh(item, bucket.mesh))
+			continue;
 
-	glBindVertexArray(0);
-	glCheckError();
+		item.instanceCount = (GLsizei)bucket.instances.size();
+		item.instanceBuffer = bucket.buffer;
+		queue.submit(item);
+	}
 }
 
-bool Renderer::validateShader(GLuint shader, ShaderType type)
+void Renderer::execute(const RenderCommandList& commands)
 {
-	int success;
-	char infoLog[512];
-
-	glGetProgramiv(shader, GL_COMPILE_STATUS, &success);
-	glCheckError();
-
-	if (!success)
+	for (const RenderCommand& command : commands.getCommands())
 	{
-		switch (type)
+		switch (command.type)
 		{
-		case VERTEX:
-		case FRAGMENT:
-			glGetShaderInfoLog(shader, 512, NULL, infoLog);
-			glCheckError();
-			std::cout << infoLog << std::endl;
+		case RENDER_COMMAND_CLEAR_COLOR:
+			clearScreen(command.values[0], command.values[1], command.values[2], command.values[3]);
+			break;
+		case RENDER_COMMAND_VIEWPORT:
+			glViewport((GLint)command.values[0], (GLint)command.values[1], (GLsizei)command.values[2], (GLsizei)command.values[3]);
 			break;
-		default:
+		case RENDER_COMMAND_VIEW_PROJECTION:
+			setViewProjection(commands.getMatrix(command.first));
+			break;
+		case RENDER_COMMAND_DRAW:
+		{
+			DrawItem item;
+			item.shader = command.shader;
+			item.material = command.material;
+			if (!setMesh(item, command.mesh))
+				break;
+
+			memcpy(item.transform, commands.getMatrix(command.first), sizeof(item.transform));
+			queue.submit(item);
+			break;
+		}
+		case RENDER_COMMAND_DRAW_INSTANCES:
+			indirect.add(command.shader, command.mesh, commands.getInstances(command.first), command.count);
 			break;
 		}
-
-		return false;
 	}
-
-	return true;
+	glCheckError();
 }
 
-bool Renderer::validateProgram(GLuint program)
+void Renderer::uploadInstances(InstanceBucket& bucket)
 {
-	int success;
-	char infoLog[512];
+	if (!bucket.buffer)
+		glGenBuffers(1, &bucket.buffer);
 
-	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	glCheckError();
+	size_t bytes = bucket.instances.size() * sizeof(InstanceData);
 
-	if (!success)
+	// Staged in the upload ring and copied on the GPU, the copy is ordered after earlier draws still reading the
+	// old instances, so the bucket keeps its store and nothing waits
+	GLintptr offset = 0;
+	void* staging = bytes <= bucket.capacity ? stream.allocate(bytes, 16, offset) : nullptr;
+	if (staging)
 	{
-		glGetProgramInfoLog(program, 512, NULL, infoLog);
-		glCheckError();
-		std::cout << infoLog << std::endl;
+		memcpy(staging, bucket.instances.data(), bytes);
+		stream.flush();
 
-		return false;
+		stateCache->bindBuffer(GL_COPY_READ_BUFFER, stream.getBuffer());
+		stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, bucket.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, (GLsizeiptr)bytes);
+		glCheckError();
+		return;
 	}
 
-	return true;
+	// Grown, or bigger than a frame of the ring. A new store, earlier draws may still be reading the old one
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, bucket.buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)bytes, bucket.instances.data(), GL_DYNAMIC_DRAW);
+	glCheckError();
+
+	bucket.capacity = bytes;
+}
+
+void Renderer::clearScreen(float r, float g, float b, float a)
+{
+	stateCache->setClearColor(r, g, b, a);
+	glCheckError();
 }
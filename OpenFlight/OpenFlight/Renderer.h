@@ -13,39 +13,105 @@
 
 #include "Types.h"
 #include "Logger.h"
+#include "FrustumCuller.h"
+#include "GLStateCache.h"
+#include "GpuCuller.h"
+#include "IndirectRenderer.h"
+#include "JobSystem.h"
+#include "MeshManager.h"
+#include "RenderCommandList.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+#include "UploadRing.h"
+
+// Index of an instance bucket in the renderer
+typedef uint32_t InstanceBucketHandle;
 
 class Renderer
 {
 public:
-	bool init(Logger primaryLogger);
+	bool init(Logger* primaryLogger, ShaderManager* primaryShaderManager, GLStateCache* primaryStateCache, JobSystem* primaryJobSystem);
 	void cleanup();
-	void setup(float* vertices);
+	void setup(const VertexLayout& layout, const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
 	void render();
 	void clearScreen(float r, float g, float b, float a);
+
+	// Submits everything recorded in the list for the next render, on the thread that owns the context
+	void execute(const RenderCommandList& commands);
+
+	// Draws for the next render, sorted by state before they are submitted
+	void submit(const DrawItem& item) { queue.submit(item); }
+	MaterialHandle addMaterial(const RenderMaterial& material) { return queue.addMaterial(material); }
+	RenderQueueStats getQueueStats() const { return queue.getStats(); }
+
+	MeshManager& getMeshes() { return meshes; }
+
+	// Per frame data, allocations are valid from the start of render until the queue has executed
+	UploadRing& getStream() { return stream; }
+	UploadRingStats getStreamStats() const { return stream.getStats(); }
+
+	// Fills in the vertex array and draw range of a mesh, false if the handle is not a live mesh
+	bool setMesh(DrawItem& item, MeshHandle mesh) const;
+
+	// Many copies of one mesh drawn with a single glDrawElementsInstanced. The shader has to be built with
+	// SHADER_FEATURE_INSTANCED. Instances stay until they are cleared and are only uploaded again after they change,
+	// so static scenery costs nothing per frame beyond the draw
+	InstanceBucketHandle addInstanceBucket(MeshHandle mesh, ShaderHandle shader, MaterialHandle material);
+	void addInstance(InstanceBucketHandle bucket, const InstanceData& instance);
+	void setInstances(InstanceBucketHandle bucket, const InstanceData* instances, uint32_t count);
+	void clearInstances(InstanceBucketHandle bucket);
+
+	// Instances of any mesh for this frame only, all of them are drawn after the queue with one
+	// glMultiDrawElementsIndirect per shader and vertex arena. The shader has to be built with SHADER_FEATURE_INSTANCED
+	void submitIndirect(ShaderHandle shader, MeshHandle mesh, const InstanceData* instances, uint32_t count) { indirect.add(shader, mesh, instances, count); }
+	IndirectStats getIndirectStats() const { return indirect.getStats(); }
+
+	// Indirect instances are culled on the GPU wherever compute shaders are supported and against the frustum on the
+	// CPU everywhere else. The matrix takes instance transforms to clip space, it is what indirect draws use as their
+	// model matrix and what is culled against
+	void setViewProjection(const float* matrix) { indirect.setViewProjection(matrix); }
+	GpuCuller& getCuller() { return culler; }
+	CullStats getCullStats() const { return culler.getStats(); }
+	FrustumCuller& getFrustumCuller() { return frustumCuller; }
+	FrustumCullStats getFrustumCullStats() const { return frustumCuller.getStats(); }
 private:
 	// TODO: Maybe create a struct to hold renderer data
 	
-	// Buffers
-	GLuint VBO;
-	GLuint VAO;
-	GLuint EBO;
-
-	// Shaders
-	GLuint vertexShader;
-	GLuint fragmentShader;
+	// Meshes, all vertex and index buffers live in the mesh manager's arenas
+	MeshManager meshes;
+	MeshHandle triangleMesh;
 
 	// Programs
-	GLuint shaderProgram;
+	ShaderHandle shaderProgram;
 
-	// Systems
-	Logger logger;
+	struct InstanceBucket
+	{
+		MeshHandle mesh;
+		ShaderHandle shader;
+		MaterialHandle material;
+		std::vector<InstanceData> instances;
+		GLuint buffer;
+		size_t capacity;		// Bytes of buffer's store
+		bool dirty;
+	};
 
-	// Functions
-	void compileShader(ShaderType type, const char* src);
-	void compileProgram();
+	std::vector<InstanceBucket> instanceBuckets;
 
-	void generateBuffers(float* vertices);
+	RenderQueue queue;
+	UploadRing stream;
+	IndirectRenderer indirect;
+	GpuCuller culler;
+	FrustumCuller frustumCuller;
+
+	// Bytes of per frame data, FRAMES times this is allocated
+	static const size_t STREAM_FRAME_BYTES = 8 * 1024 * 1024;
+
+	// Systems
+	Logger* logger;
+	ShaderManager* shaderManager;
+	GLStateCache* stateCache;
+	JobSystem* jobSystem;
 
-	bool validateShader(GLuint shader, ShaderType type);
-	bool validateProgram(GLuint program);
+	void submitInstances();
+	void uploadInstances(InstanceBucket& bucket);
 };
\ No newline at end of file
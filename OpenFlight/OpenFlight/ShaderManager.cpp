@@ -4,11 +4,1149 @@
 * ShaderManager.cpp
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include <GLFW/glfw3.h>
+
 #include "ShaderManager.h"
 
-bool ShaderManager::initializeShaderManager()
+// GL_KHR_parallel_shader_compile (and the identical ARB version), glad is generated without extensions
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP maxShaderCompilerThreadsProc)(GLuint count);
+
+const char* const SHADER_CACHE_DIRECTORY = "ShaderCache";
+
+const char* const shaderFeatureNames[SHADER_FEATURE_COUNT] = { "FOG", "SHADOWS", "INSTANCED" };
+
+// Deeper than this is almost certainly an include cycle
+const uint32_t SHADER_MAX_INCLUDE_DEPTH = 16;
+
+// Without parallel compile support checking a build waits for the driver,
+// so stop finishing builds for the frame once this much time has gone into it
+const double SHADER_FINISH_BUDGET_MS = 4.0;
+
+// Header of a cached program binary, followed by length bytes of driver data
+struct ShaderBinaryHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+const char SHADER_BINARY_MAGIC[4] = { 'O', 'F', 'S', 'B' };
+const uint32_t SHADER_BINARY_VERSION = 1;
+
+// FNV-1a, chained through seed so several strings can go into one key
+static uint64_t hashShaderData(uint64_t seed, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+		seed = (seed ^ bytes[i]) * 1099511628211ULL;
+
+	return seed;
+}
+
+static uint64_t hashShaderString(uint64_t seed, const GLubyte* str)
+{
+	if (!str)
+		return seed;
+
+	// Include the terminator so "ab" + "c" and "a" + "bc" differ
+	return hashShaderData(seed, str, strlen((const char*)str) + 1);
+}
+
+static bool isIdentifierChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// True if name appears in source as a whole identifier
+static bool containsToken(const std::string& source, const char* name)
+{
+	size_t length = strlen(name);
+
+	for (size_t at = source.find(name); at != std::string::npos; at = source.find(name, at + 1))
+	{
+		bool start = at == 0 || !isIdentifierChar(source[at - 1]);
+		bool end = at + length == source.size() || !isIdentifierChar(source[at + length]);
+
+		if (start && end)
+			return true;
+	}
+
+	return false;
+}
+
+static void logInfoLog(Logger* logger, const std::string& infoLog)
+{
+	// Line by line, a whole compiler log does not fit in one log message
+	size_t start = 0;
+	while (start < infoLog.size())
+	{
+		size_t end = infoLog.find('\n', start);
+		if (end == std::string::npos)
+			end = infoLog.size();
+
+		std::string line = infoLog.substr(start, end - start);
+		if (!line.empty() && line[0] != '\0')
+			OF_LOG(*logger, LOG_LVL_ERR, "    {}", line);
+
+		start = end + 1;
+	}
+}
+
+static bool hasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp((const char*)extension, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+ShaderManager::ShaderManager()
+	: logger(nullptr), fileManager(nullptr), stateCache(nullptr), stats(), binaryCache(false), driverHash(0), parallelCompile(false), pendingLoads(0), loading(false)
+{
+}
+
+bool ShaderManager::init(Logger* primaryLogger, FileManager* primaryFileManager, GLStateCache* primaryStateCache)
+{
+	logger = primaryLogger;
+	fileManager = primaryFileManager;
+	stateCache = primaryStateCache;
+
+	const char* parallelName = hasExtension("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR" :
+		hasExtension("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB" : nullptr;
+	maxShaderCompilerThreadsProc maxShaderCompilerThreads = parallelName ? (maxShaderCompilerThreadsProc)glfwGetProcAddress(parallelName) : nullptr;
+
+	parallelCompile = maxShaderCompilerThreads != nullptr;
+	if (parallelCompile)
+	{
+		// 0 means compiles are not threaded at all, in that case let the driver use as many threads as it wants
+		GLint threads = 0;
+		glGetIntegerv(GL_MAX_SHADER_COMPILER_THREADS_KHR, &threads);
+		if (threads == 0)
+		{
+			maxShaderCompilerThreads(0xFFFFFFFF);
+			glGetIntegerv(GL_MAX_SHADER_COMPILER_THREADS_KHR, &threads);
+		}
+		stats.compilerThreads = (uint32_t)threads;
+	}
+	else
+	{
+		OF_LOG(*logger, LOG_LVL_INFO, "Parallel shader compile is not supported, shader builds are finished one at a time");
+	}
+
+	// Binaries are only valid for the exact driver that produced them
+	driverHash = 14695981039346656037ULL;
+	driverHash = hashShaderString(driverHash, glGetString(GL_VENDOR));
+	driverHash = hashShaderString(driverHash, glGetString(GL_RENDERER));
+	driverHash = hashShaderString(driverHash, glGetString(GL_VERSION));
+
+	// glGetProgramBinary is core since 4.1, drivers that support it but list no formats never return anything usable
+	GLint formats = 0;
+	if (GLAD_GL_VERSION_4_1)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+	binaryCache = formats > 0;
+	if (!binaryCache)
+	{
+		OF_LOG(*logger, LOG_LVL_INFO, "Program binaries are not supported, shaders will be compiled on every start");
+		return true;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+	if (error)
+	{
+		OF_LOG(*logger, LOG_LVL_WRN, "Failed to create the shader cache directory {}", SHADER_CACHE_DIRECTORY);
+		binaryCache = false;
+	}
+
+	return true;
+}
+
+void ShaderManager::cleanup()
+{
+	for (auto& entry : programs)
+	{
+		ShaderProgram& shaderProgram = entry.second;
+
+		glDeleteShader(shaderProgram.pendingVertex);
+		glDeleteShader(shaderProgram.pendingFragment);
+		glDeleteProgram(shaderProgram.pendingProgram);
+		glDeleteProgram(shaderProgram.program);
+	}
+
+	programs.clear();
+	variants.clear();
+	variantLookup.clear();
+	fileVariants.clear();
+	pendingLoads = 0;
+	loading = false;
+}
+
+ShaderHandle ShaderManager::loadProgram(const char* vertexPath, const char* fragmentPath, ShaderFeatures features)
+{
+	std::string request = std::string(vertexPath) + "|" + fragmentPath + "|" + std::to_string(features);
+
+	auto existing = variantLookup.find(request);
+	if (existing != variantLookup.end())
+		return existing->second;
+
+	if (!loading)
+	{
+		loading = true;
+		loadStart = std::chrono::steady_clock::now();
+	}
+
+	ShaderHandle handle = (ShaderHandle)variants.size();
+	variantLookup[request] = handle;
+	stats.variants++;
+
+	variants.emplace_back();
+	ShaderVariant& variant = variants.back();
+	variant.vertexPath = vertexPath;
+	variant.fragmentPath = fragmentPath;
+	variant.features = features;
+	variant.programKey = buildVariant(handle, true);
+
+	return handle;
+}
+
+ShaderHandle ShaderManager::loadComputeProgram(const char* computePath, ShaderFeatures features)
+{
+	// Variants without a fragment shader are compute programs
+	return loadProgram(computePath, "", features);
+}
+
+GLuint ShaderManager::getProgram(ShaderHandle handle) const
+{
+	if (handle >= variants.size())
+		return 0;
+
+	auto it = programs.find(variants[handle].programKey);
+	if (it == programs.end())
+		return 0;
+
+	return it->second.program;
+}
+
+void ShaderManager::update()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Start rebuilding variants whose files changed, one rebuild per variant at a time. Their files are read in the
+	// background first and the build is issued by a later update, once all of them are in the asset cache
+	for (ShaderHandle handle = 0; handle < variants.size(); handle++)
+	{
+		ShaderVariant& variant = variants[handle];
+		if (variant.reloadRequested && !variant.pendingKey && !variant.reloading)
+		{
+			variant.reloadRequested = false;
+			variant.reloading = true;
+			readSources(handle, variant.watchedFiles);
+		}
+
+		if (!variant.reloading || variant.sourcesPending > 0)
+			continue;
+
+		std::vector<std::string> missing;
+		uint64_t key = buildVariant(handle, false, &missing);
+
+		// Includes added by the change have not been read yet, anything that was read and is still missing is gone
+		std::vector<std::string> unread;
+		for (const std::string& file : missing)
+		{
+			if (std::find(variant.readFiles.begin(), variant.readFiles.end(), file) == variant.readFiles.end())
+				unread.push_back(file);
+		}
+
+		if (!unread.empty())
+		{
+			readSources(handle, unread);
+			continue;
+		}
+
+		variant.reloading = false;
+		variant.readFiles.clear();
+		variant.sources.clear();
+
+		if (key == variant.programKey)
+		{
+			// Saved without any change that matters to this variant
+			releaseProgram(key);
+			continue;
+		}
+
+		if (!key)
+			OF_LOG(*logger, LOG_LVL_ERR, "Failed to read shader program {}, keeping the previous version", variant.getName());
+
+		variant.pendingKey = key;
+	}
+
+	for (auto& entry : programs)
+	{
+		ShaderProgram& shaderProgram = entry.second;
+		if (shaderProgram.state != SHADER_LINKING)
+			continue;
+
+		if (!parallelCompile && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > SHADER_FINISH_BUDGET_MS)
+			break;
+
+		if (isBuildComplete(shaderProgram))
+			completeBuild(shaderProgram);
+	}
+
+	// Swap finished rebuilds in, failed ones are dropped and the variant keeps its old program
+	for (ShaderVariant& variant : variants)
+	{
+		if (!variant.pendingKey)
+			continue;
+
+		ShaderProgram& pending = programs[variant.pendingKey];
+		if (pending.state == SHADER_LINKING)
+			continue;
+
+		if (pending.program)
+		{
+			releaseProgram(variant.programKey);
+			variant.programKey = variant.pendingKey;
+			OF_LOG(*logger, LOG_LVL_INFO, "Reloaded shader program {}", pending.name);
+		}
+		else
+		{
+			if (getProgram((ShaderHandle)(&variant - variants.data())))
+				OF_LOG(*logger, LOG_LVL_WRN, "Keeping the previous version of shader program {}", pending.name);
+			releaseProgram(variant.pendingKey);
+		}
+
+		variant.pendingKey = 0;
+	}
+
+	if (loading && pendingLoads == 0)
+	{
+		loading = false;
+		stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+		// Cold starts compile everything, warm starts should be almost entirely binary cache loads
+		OF_LOG(*logger, LOG_LVL_INFO, "Loaded shaders in {} ms ({} variants, {} shared, {} from the binary cache, {} compiled, {} failed, parallel compile {})",
+			stats.loadMs, stats.variants, stats.sharedPrograms, stats.cachedPrograms, stats.compiledPrograms, stats.failedPrograms, parallelCompile);
+	}
+}
+
+void ShaderManager::finishLoading()
+{
+	for (auto& entry : programs)
+	{
+		if (entry.second.state == SHADER_LINKING)
+			completeBuild(entry.second);
+	}
+
+	update();
+}
+
+uint64_t ShaderManager::buildVariant(ShaderHandle handle, bool initialBuild, std::vector<std::string>* missing)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ShaderVariant& variant = variants[handle];
+
+	// Features a stage never mentions are left out, so they cannot make otherwise identical sources differ
+	std::string vertexSource;
+	std::string fragmentSource;
+	std::vector<std::string> vertexFiles;
+	std::vector<std::string> fragmentFiles;
+
+	bool compute = variant.fragmentPath.empty();
+	bool success = preprocess(variant.vertexPath, variant.features, vertexSource, vertexFiles, missing);
+	if (!compute)
+		success &= preprocess(variant.fragmentPath, variant.features, fragmentSource, fragmentFiles, missing);
+
+	// Watch whatever could be found, so a missing include that gets created later is picked up too
+	watchFiles(handle, vertexFiles);
+	watchFiles(handle, fragmentFiles);
+
+	if (!success)
+	{
+		if (initialBuild)
+		{
+			OF_LOG(*logger, LOG_LVL_ERR, "Failed to load shader program {}", variant.getName());
+			stats.failedPrograms++;
+		}
+		return 0;
+	}
+
+	uint64_t vertexSize = vertexSource.size();
+	uint64_t fragmentSize = fragmentSource.size();
+
+	uint64_t key = hashShaderData(driverHash, &vertexSize, sizeof(vertexSize));
+	key = hashShaderData(key, vertexSource.data(), vertexSource.size());
+	key = hashShaderData(key, &fragmentSize, sizeof(fragmentSize));
+	key = hashShaderData(key, fragmentSource.data(), fragmentSource.size());
+
+	// 0 means no program
+	if (key == 0)
+		key = 1;
+
+	ShaderProgram& shaderProgram = programs[key];
+	if (shaderProgram.refCount++ > 0)
+	{
+		if (initialBuild)
+			stats.sharedPrograms++;
+		return key;
+	}
+
+	shaderProgram.key = key;
+	shaderProgram.compute = compute;
+	shaderProgram.name = variant.getName();
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+	{
+		if (variant.features & (1 << i))
+			shaderProgram.name += std::string(" ") + shaderFeatureNames[i];
+	}
+
+	if (loadBinary(shaderProgram))
+	{
+		if (initialBuild)
+			stats.cachedPrograms++;
+		stats.cachedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		return key;
+	}
+
+	// Only issued here, update picks the result up once the driver has it
+	shaderProgram.vertexSource = std::move(vertexSource);
+	shaderProgram.fragmentSource = std::move(fragmentSource);
+	shaderProgram.vertexFiles = std::move(vertexFiles);
+	shaderProgram.fragmentFiles = std::move(fragmentFiles);
+	beginBuild(shaderProgram);
+
+	shaderProgram.state = SHADER_LINKING;
+	shaderProgram.initialBuild = initialBuild;
+	if (initialBuild)
+		pendingLoads++;
+
+	stats.issueMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return key;
+}
+
+void ShaderManager::readSources(ShaderHandle handle, const std::vector<std::string>& files)
+{
+	ShaderVariant& variant = variants[handle];
+	variant.readFiles.insert(variant.readFiles.end(), files.begin(), files.end());
+	variant.sourcesPending += (uint32_t)files.size();
+
+	// Runs on the render thread from FileManager::pollCompletions, or straight away for cached files
+	fileManager->loadAssetsAsync(files, [this, handle](const std::string&, AssetHandle& asset) {
+		if (handle >= variants.size() || variants[handle].sourcesPending == 0)
+			return;
+
+		ShaderVariant& target = variants[handle];
+		if (asset)
+			target.sources.push_back(asset);
+		target.sourcesPending--;
+	});
+}
+
+void ShaderManager::watchFiles(ShaderHandle handle, const std::vector<std::string>& files)
+{
+	for (const std::string& file : files)
+	{
+		std::vector<std::string>& watched = variants[handle].watchedFiles;
+		if (std::find(watched.begin(), watched.end(), file) != watched.end())
+			continue;
+
+		watched.push_back(file);
+
+		std::vector<ShaderHandle>& dependents = fileVariants[file];
+		dependents.push_back(handle);
+		if (dependents.size() > 1)
+			continue;
+
+		// Runs on the render thread from FileManager::pollCompletions, once per save for all of the file's variants
+		fileManager->watchFile(file, [this](const std::string& path) {
+			auto it = fileVariants.find(path);
+			if (it == fileVariants.end())
+				return;
+
+			OF_LOG(*logger, LOG_LVL_DEBUG, "Shader source {} changed, reloading {} variants", path, it->second.size());
+			for (ShaderHandle dependent : it->second)
+			{
+				if (dependent < variants.size())
+					variants[dependent].reloadRequested = true;
+			}
+		});
+	}
+}
+
+void ShaderManager::releaseProgram(uint64_t key)
+{
+	auto it = programs.find(key);
+	if (it == programs.end() || --it->second.refCount > 0)
+		return;
+
+	ShaderProgram& shaderProgram = it->second;
+	if (shaderProgram.state == SHADER_LINKING && shaderProgram.initialBuild)
+		pendingLoads--;
+
+	glDeleteShader(shaderProgram.pendingVertex);
+	glDeleteShader(shaderProgram.pendingFragment);
+	glDeleteProgram(shaderProgram.pendingProgram);
+	glDeleteProgram(shaderProgram.program);
+
+	programs.erase(it);
+}
+
+bool ShaderManager::preprocess(const std::string& path, ShaderFeatures features, std::string& output, std::vector<std::string>& files, std::vector<std::string>* missing)
+{
+	std::string expanded;
+	if (!expandIncludes(path, expanded, files, 0, missing))
+		return false;
+
+	// #version has to stay the first line, so the defines go straight after it
+	size_t insert = 0;
+	uint32_t versionLine = 0;
+
+	size_t first = expanded.find_first_not_of(" \t\r\n");
+	if (first != std::string::npos && expanded.compare(first, 8, "#version") == 0)
+	{
+		insert = expanded.find('\n', first);
+		insert = insert == std::string::npos ? expanded.size() : insert + 1;
+		versionLine = (uint32_t)std::count(expanded.begin(), expanded.begin() + insert, '\n');
+	}
+
+	std::string defines;
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+	{
+		if ((features & (1 << i)) && containsToken(expanded, shaderFeatureNames[i]))
+			defines += std::string("#define ") + shaderFeatureNames[i] + " 1\n";
+	}
+
+	if (defines.empty())
+	{
+		output = std::move(expanded);
+		return true;
+	}
+
+	// Put the line numbers in compile errors back where they were
+	if (insert == expanded.size() || expanded[insert - 1] != '\n')
+		defines.insert(0, "\n");
+	defines += "#line " + std::to_string(versionLine + 1) + " 0\n";
+
+	output.reserve(expanded.size() + defines.size());
+	output.assign(expanded, 0, insert);
+	output += defines;
+	output.append(expanded, insert, std::string::npos);
+
+	return true;
+}
+
+bool ShaderManager::expandIncludes(const std::string& path, std::string& output, std::vector<std::string>& files, uint32_t depth, std::vector<std::string>* missing)
+{
+	if (depth > SHADER_MAX_INCLUDE_DEPTH)
+	{
+		OF_LOG(*logger, LOG_LVL_ERR, "Shader includes nested too deep at {}", path);
+		return false;
+	}
+
+	// Includes go through the asset cache, files shared by many variants are only read once. Reloads never read
+	// here, they only take what was read in the background and report the rest as missing
+	AssetHandle source = missing ? fileManager->findAsset(path.c_str()) : fileManager->loadAsset(path.c_str());
+	if (!source)
+	{
+		if (missing)
+			missing->push_back(path);
+		return false;
+	}
+
+	// Files are numbered in the order they were included, that is the source number in compile errors
+	uint32_t fileIndex = (uint32_t)files.size();
+	files.push_back(path);
+
+	std::string directory;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != std::string::npos)
+		directory = path.substr(0, slash + 1);
+
+	const char* data = source.getData();
+	const char* end = data + source.getSize();
+	uint32_t lineNumber = 0;
+
+	for (const char* line = data; line < end;)
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', (size_t)(end - line));
+		if (!lineEnd)
+			lineEnd = end;
+		lineNumber++;
+
+		const char* c = line;
+		while (c < lineEnd && (*c == ' ' || *c == '\t'))
+			c++;
+
+		const char* quote = nullptr;
+		const char* quoteEnd = nullptr;
+		if ((size_t)(lineEnd - c) > 8 && strncmp(c, "#include", 8) == 0)
+		{
+			quote = (const char*)memchr(c + 8, '"', (size_t)(lineEnd - c - 8));
+			quoteEnd = quote ? (const char*)memchr(quote + 1, '"', (size_t)(lineEnd - quote - 1)) : nullptr;
+		}
+
+		if (quoteEnd)
+		{
+			std::string includePath = directory + std::string(quote + 1, quoteEnd);
+
+			// Every file is only included once, like #pragma once in C
+			if (std::find(files.begin(), files.end(), includePath) == files.end())
+			{
+				output += "#line 1 " + std::to_string(files.size()) + "\n";
+
+				if (!expandIncludes(includePath, output, files, depth + 1, missing))
+				{
+					if (!missing || missing->empty())
+						OF_LOG(*logger, LOG_LVL_ERR, "Included from {} line {}", path, lineNumber);
+					return false;
+				}
+
+				if (!output.empty() && output.back() != '\n')
+					output += '\n';
+			}
+
+			output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+		}
+		else
+		{
+			output.append(line, lineEnd);
+			if (lineEnd < end)
+				output += '\n';
+		}
+
+		line = lineEnd + 1;
+	}
+
+	return true;
+}
+
+void ShaderManager::beginBuild(ShaderProgram& shaderProgram)
+{
+	shaderProgram.pendingVertex = compileShader(shaderProgram.compute ? COMPUTE : VERTEX, shaderProgram.vertexSource);
+	shaderProgram.pendingFragment = shaderProgram.compute ? 0 : compileShader(FRAGMENT, shaderProgram.fragmentSource);
+	shaderProgram.pendingProgram = compileProgram(shaderProgram.pendingVertex, shaderProgram.pendingFragment);
+
+	shaderProgram.vertexSource.clear();
+	shaderProgram.vertexSource.shrink_to_fit();
+	shaderProgram.fragmentSource.clear();
+	shaderProgram.fragmentSource.shrink_to_fit();
+}
+
+bool ShaderManager::finishBuild(ShaderProgram& shaderProgram)
 {
-    // TODO: Interface with file manager to check if it is possible to read any possible shader files
+	// Querying the status is what waits for the driver, so this is the only blocking part of a build
+	bool success = validateShader(shaderProgram.pendingVertex, shaderProgram);
+	if (!shaderProgram.compute)
+		success &= validateShader(shaderProgram.pendingFragment, shaderProgram);
+	success = success && validateProgram(shaderProgram.pendingProgram, shaderProgram);
+
+	glDeleteShader(shaderProgram.pendingVertex);
+	glDeleteShader(shaderProgram.pendingFragment);
+	shaderProgram.pendingVertex = 0;
+	shaderProgram.pendingFragment = 0;
+	shaderProgram.vertexFiles.clear();
+	shaderProgram.fragmentFiles.clear();
+
+	if (!success)
+	{
+		glDeleteProgram(shaderProgram.pendingProgram);
+		shaderProgram.pendingProgram = 0;
+
+		return false;
+	}
+
+	shaderProgram.program = shaderProgram.pendingProgram;
+	shaderProgram.pendingProgram = 0;
+	reflectProgram(shaderProgram);
+
+	if (binaryCache)
+		saveBinary(shaderProgram);
+
+	return true;
+}
+
+bool ShaderManager::isBuildComplete(const ShaderProgram& shaderProgram) const
+{
+	// Without the extension there is no way to ask, checking the status just waits
+	if (!parallelCompile)
+		return true;
+
+	GLint complete = GL_FALSE;
+	glGetProgramiv(shaderProgram.pendingProgram, GL_COMPLETION_STATUS_KHR, &complete);
+
+	return complete == GL_TRUE;
+}
+
+void ShaderManager::completeBuild(ShaderProgram& shaderProgram)
+{
+	bool success = finishBuild(shaderProgram);
+	shaderProgram.state = SHADER_IDLE;
+
+	if (!shaderProgram.initialBuild)
+		return;
+
+	shaderProgram.initialBuild = false;
+	pendingLoads--;
+
+	if (success)
+		stats.compiledPrograms++;
+	else
+		stats.failedPrograms++;
+}
+
+void ShaderManager::setUniform(ShaderHandle handle, uint64_t name, int value)
+{
+	GLuint program = updateUniform(handle, name, &value, sizeof(value));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniform1i(program, getUniformLocation(handle, name), value);
+	else
+		glUniform1i(getUniformLocation(handle, name), value);
+}
+
+void ShaderManager::setUniform(ShaderHandle handle, uint64_t name, float x)
+{
+	GLuint program = updateUniform(handle, name, &x, sizeof(x));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniform1f(program, getUniformLocation(handle, name), x);
+	else
+		glUniform1f(getUniformLocation(handle, name), x);
+}
+
+void ShaderManager::setUniform(ShaderHandle handle, uint64_t name, float x, float y)
+{
+	float value[2] = { x, y };
+	GLuint program = updateUniform(handle, name, value, sizeof(value));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniform2fv(program, getUniformLocation(handle, name), 1, value);
+	else
+		glUniform2fv(getUniformLocation(handle, name), 1, value);
+}
+
+void ShaderManager::setUniform(ShaderHandle handle, uint64_t name, float x, float y, float z)
+{
+	float value[3] = { x, y, z };
+	GLuint program = updateUniform(handle, name, value, sizeof(value));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniform3fv(program, getUniformLocation(handle, name), 1, value);
+	else
+		glUniform3fv(getUniformLocation(handle, name), 1, value);
+}
+
+void ShaderManager::setUniform(ShaderHandle handle, uint64_t name, float x, float y, float z, float w)
+{
+	float value[4] = { x, y, z, w };
+	GLuint program = updateUniform(handle, name, value, sizeof(value));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniform4fv(program, getUniformLocation(handle, name), 1, value);
+	else
+		glUniform4fv(getUniformLocation(handle, name), 1, value);
+}
+
+void ShaderManager::setUniformMatrix4(ShaderHandle handle, uint64_t name, const float* matrix)
+{
+	GLuint program = updateUniform(handle, name, matrix, 16 * sizeof(float));
+	if (!program)
+		return;
+
+	if (GLAD_GL_VERSION_4_1)
+		glProgramUniformMatrix4fv(program, getUniformLocation(handle, name), 1, GL_FALSE, matrix);
+	else
+		glUniformMatrix4fv(getUniformLocation(handle, name), 1, GL_FALSE, matrix);
+}
+
+void ShaderManager::setUniformBlock(ShaderHandle handle, uint64_t name, GLuint bindingPoint)
+{
+	GLuint program = updateUniform(handle, name, &bindingPoint, sizeof(bindingPoint));
+	if (!program)
+		return;
+
+	// Block bindings are program state in every version, no need to bind anything
+	glUniformBlockBinding(program, (GLuint)getUniformLocation(handle, name), bindingPoint);
+}
+
+GLint ShaderManager::getUniformLocation(ShaderHandle handle, uint64_t name) const
+{
+	if (handle >= variants.size())
+		return -1;
+
+	auto it = programs.find(variants[handle].programKey);
+	if (it == programs.end())
+		return -1;
+
+	const UniformSlot* slot = findUniform(it->second, name);
+
+	return slot ? slot->location : -1;
+}
+
+void ShaderManager::reflectProgram(ShaderProgram& shaderProgram)
+{
+	GLuint program = shaderProgram.program;
+
+	GLint uniformCount = 0;
+	GLint blockCount = 0;
+	GLint nameLength = 0;
+	GLint blockNameLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &nameLength);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &blockNameLength);
+
+	// At most half full, so probes stay short
+	size_t tableSize = 8;
+	while (tableSize < (size_t)(uniformCount + blockCount) * 2)
+		tableSize *= 2;
+
+	shaderProgram.uniforms.assign(tableSize, UniformSlot());
+	shaderProgram.uniformValues.clear();
+
+	std::string name((size_t)std::max(nameLength, blockNameLength) + 1, '\0');
+
+	for (GLint i = 0; i < uniformCount; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+
+		// Members of uniform blocks have no location, they are set through the block's buffer
+		GLint location = glGetUniformLocation(program, name.c_str());
+		if (location < 0)
+			continue;
+
+		// Arrays are reported as "name[0]", they are set by their plain name
+		std::string uniform(name.c_str(), (size_t)length);
+		if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+			uniform.resize(uniform.size() - 3);
+
+		// Only the first element is cached, that is all the setters write
+		uint32_t valueSize;
+		switch (type)
+		{
+		case GL_FLOAT_VEC2: valueSize = 2 * sizeof(float); break;
+		case GL_FLOAT_VEC3: valueSize = 3 * sizeof(float); break;
+		case GL_FLOAT_VEC4: valueSize = 4 * sizeof(float); break;
+		case GL_FLOAT_MAT4: valueSize = 16 * sizeof(float); break;
+		default: valueSize = 4; break;	// float, int, bool and samplers
+		}
+
+		addUniform(shaderProgram, uniform.c_str(), location, false, valueSize);
+	}
+
+	for (GLint i = 0; i < blockCount; i++)
+	{
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(program, (GLuint)i, (GLsizei)name.size(), &length, &name[0]);
+
+		addUniform(shaderProgram, std::string(name.c_str(), (size_t)length).c_str(), i, true, sizeof(GLuint));
+	}
+}
+
+void ShaderManager::addUniform(ShaderProgram& shaderProgram, const char* name, GLint location, bool block, uint32_t valueSize)
+{
+	uint64_t hash = uniformName(name);
+	size_t mask = shaderProgram.uniforms.size() - 1;
+
+	for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+	{
+		UniformSlot& slot = shaderProgram.uniforms[i];
+		if (slot.name == hash)
+			return;
+
+		if (slot.name != 0)
+			continue;
+
+		slot.name = hash;
+		slot.location = location;
+		slot.block = block;
+		slot.valueOffset = (uint32_t)shaderProgram.uniformValues.size();
+		slot.valueSize = valueSize;
+		shaderProgram.uniformValues.resize(shaderProgram.uniformValues.size() + valueSize);
+
+		return;
+	}
+}
+
+const ShaderManager::UniformSlot* ShaderManager::findUniform(const ShaderProgram& shaderProgram, uint64_t name) const
+{
+	if (shaderProgram.uniforms.empty())
+		return nullptr;
+
+	size_t mask = shaderProgram.uniforms.size() - 1;
+	for (size_t i = (size_t)name & mask;; i = (i + 1) & mask)
+	{
+		const UniformSlot& slot = shaderProgram.uniforms[i];
+		if (slot.name == name)
+			return &slot;
+
+		if (slot.name == 0)
+			return nullptr;
+	}
+}
+
+GLuint ShaderManager::updateUniform(ShaderHandle handle, uint64_t name, const void* value, uint32_t size)
+{
+	if (handle >= variants.size())
+		return 0;
+
+	auto it = programs.find(variants[handle].programKey);
+	if (it == programs.end() || !it->second.program)
+		return 0;
+
+	ShaderProgram& shaderProgram = it->second;
+	UniformSlot* slot = (UniformSlot*)findUniform(shaderProgram, name);
+	if (!slot || slot->valueSize != size)
+	{
+		stats.uniformsMissing++;
+		return 0;
+	}
+
+	unsigned char* cached = shaderProgram.uniformValues.data() + slot->valueOffset;
+	if (slot->hasValue && memcmp(cached, value, size) == 0)
+	{
+		stats.uniformsSkipped++;
+		return 0;
+	}
+
+	memcpy(cached, value, size);
+	slot->hasValue = true;
+	stats.uniformsIssued++;
+
+	// Uniforms of plain 3.3 contexts can only be set on the bound program
+	if (!GLAD_GL_VERSION_4_1 && !slot->block)
+	{
+		if (stateCache)
+			stateCache->useProgram(shaderProgram.program);
+		else
+			glUseProgram(shaderProgram.program);
+	}
+
+	return shaderProgram.program;
+}
+
+std::string ShaderManager::binaryPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+	return std::string(SHADER_CACHE_DIRECTORY) + "/" + name;
+}
+
+bool ShaderManager::loadBinary(ShaderProgram& shaderProgram)
+{
+	if (!binaryCache)
+		return false;
+
+	std::string path = binaryPath(shaderProgram.key);
+
+	// A miss is the normal cold start, do not let FileManager report it as an error
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return false;
+
+	FileView view = fileManager->readFile(path.c_str());
+	if (view.getSize() < sizeof(ShaderBinaryHeader))
+		return false;
+
+	ShaderBinaryHeader header;
+	memcpy(&header, view.getData(), sizeof(header));
+
+	if (memcmp(header.magic, SHADER_BINARY_MAGIC, sizeof(header.magic)) != 0 || header.version != SHADER_BINARY_VERSION ||
+		header.key != shaderProgram.key || header.length != view.getSize() - sizeof(header))
+		return false;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, (GLenum)header.format, view.getData() + sizeof(header), (GLsizei)header.length);
+
+	// Drivers are allowed to reject their own binaries after an update, that is not an error
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		OF_LOG(*logger, LOG_LVL_INFO, "Cached binary of {} was rejected by the driver, recompiling", shaderProgram.name);
+		glDeleteProgram(program);
+		return false;
+	}
+
+	shaderProgram.program = program;
+	reflectProgram(shaderProgram);
+
+	return true;
+}
+
+void ShaderManager::saveBinary(const ShaderProgram& shaderProgram)
+{
+	GLint length = 0;
+	glGetProgramiv(shaderProgram.program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> data(sizeof(ShaderBinaryHeader) + (size_t)length);
+	GLenum format = 0;
+	glGetProgramBinary(shaderProgram.program, length, &length, &format, data.data() + sizeof(ShaderBinaryHeader));
+
+	ShaderBinaryHeader header;
+	memcpy(header.magic, SHADER_BINARY_MAGIC, sizeof(header.magic));
+	header.version = SHADER_BINARY_VERSION;
+	header.key = shaderProgram.key;
+	header.format = format;
+	header.length = (uint32_t)length;
+	memcpy(data.data(), &header, sizeof(header));
+
+	// Written to a temporary file first so a crash never leaves a truncated binary behind
+	std::string path = binaryPath(shaderProgram.key);
+	std::string tempPath = path + ".tmp";
+
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (!file)
+		return;
+
+	size_t count = fwrite(data.data(), 1, sizeof(header) + (size_t)length, file);
+	fclose(file);
+
+	std::error_code error;
+	if (count == sizeof(header) + (size_t)length)
+		std::filesystem::rename(tempPath, path, error);
+	else
+		error = std::make_error_code(std::errc::io_error);
+
+	if (error)
+	{
+		OF_LOG(*logger, LOG_LVL_WRN, "Failed to write the shader binary {}", path);
+		std::filesystem::remove(tempPath, error);
+		return;
+	}
+
+	stats.binariesWritten++;
+}
+
+GLuint ShaderManager::compileShader(ShaderType type, const std::string& source)
+{
+	GLuint shader;
+
+	switch (type)
+	{
+	case VERTEX:
+		shader = glCreateShader(GL_VERTEX_SHADER);
+		break;
+	case FRAGMENT:
+		shader = glCreateShader(GL_FRAGMENT_SHADER);
+		break;
+	case COMPUTE:
+		shader = glCreateShader(GL_COMPUTE_SHADER);
+		break;
+	default:
+		OF_LOG(*logger, LOG_LVL_ERR, "Fatal Error: Shader type unkown");
+		return 0;
+	}
+
+	const GLchar* src = source.c_str();
+	GLint length = (GLint)source.size();
+
+	glShaderSource(shader, 1, &src, &length);
+	glCompileShader(shader);
+
+	return shader;
+}
+
+GLuint ShaderManager::compileProgram(GLuint vertexShader, GLuint fragmentShader)
+{
+	GLuint program = glCreateProgram();
+
+	if (binaryCache)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glAttachShader(program, vertexShader);
+	if (fragmentShader)
+		glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+
+	return program;
+}
+
+bool ShaderManager::validateShader(GLuint shader, const ShaderProgram& shaderProgram)
+{
+	GLint success = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+
+	if (!success)
+	{
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+		std::string infoLog(length > 0 ? (size_t)length : 1, '\0');
+		glGetShaderInfoLog(shader, (GLsizei)infoLog.size(), NULL, &infoLog[0]);
+
+		GLint type = 0;
+		glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+
+		// Source numbers in the log are the files in include order, starting with the one that was loaded
+		const char* stage = type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute";
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to compile the {} shader of {}:", stage, shaderProgram.name);
+		logInfoLog(logger, infoLog);
+
+		const std::vector<std::string>& files = type == GL_FRAGMENT_SHADER ? shaderProgram.fragmentFiles : shaderProgram.vertexFiles;
+		for (size_t i = 0; i < files.size(); i++)
+			OF_LOG(*logger, LOG_LVL_ERR, "    source {} is {}", i, files[i]);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool ShaderManager::validateProgram(GLuint program, const ShaderProgram& shaderProgram)
+{
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+	if (!success)
+	{
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+
+		std::string infoLog(length > 0 ? (size_t)length : 1, '\0');
+		glGetProgramInfoLog(program, (GLsizei)infoLog.size(), NULL, &infoLog[0]);
+
+		OF_LOG(*logger, LOG_LVL_ERR, "Failed to link shader program {}:", shaderProgram.name);
+		logInfoLog(logger, infoLog);
+
+		return false;
+	}
 
-    return false;
+	return true;
 }
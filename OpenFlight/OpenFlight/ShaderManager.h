@@ -6,10 +6,237 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "FileManager.h"
+#include "GLStateCache.h"
+#include "Logger.h"
+#include "Types.h"
+
+// Index of a shader variant in the shader manager, stays the same when the program is reloaded
+typedef uint32_t ShaderHandle;
+const ShaderHandle INVALID_SHADER = 0xFFFFFFFF;
+
+// Optional features compiled into a variant, each one is injected as #define <NAME> 1
+enum shaderFeature
+{
+	SHADER_FEATURE_FOG = 1 << 0,
+	SHADER_FEATURE_SHADOWS = 1 << 1,
+	SHADER_FEATURE_INSTANCED = 1 << 2,
+};
+
+typedef uint32_t ShaderFeatures;
+
+const uint32_t SHADER_FEATURE_COUNT = 3;
+extern const char* const shaderFeatureNames[SHADER_FEATURE_COUNT];
+
+// Uniforms and uniform blocks are looked up by the FNV-1a hash of their name, constexpr so
+// constant names like uniformName("fogColour") can be hashed at compile time
+constexpr uint64_t uniformName(const char* name)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 1099511628211ULL;
+
+	return hash;
+}
+
+// Where startup time went, loads through the binary cache versus full compiles
+struct ShaderStats
+{
+	uint32_t variants;
+	uint32_t sharedPrograms;	// Variants that expanded to the same sources as an existing program
+	uint32_t cachedPrograms;
+	uint32_t compiledPrograms;
+	uint32_t failedPrograms;
+	uint32_t binariesWritten;
+	uint32_t compilerThreads;	// 0 without parallel shader compile support, 0xFFFFFFFF when the driver decides
+	double cachedMs;			// Main thread time spent loading binaries
+	double issueMs;				// Main thread time spent preprocessing and handing sources to the driver
+	double loadMs;				// Wall time from the first load until the last program was ready
+
+	// Uniform uploads, skipped ones had the same value as the last upload to that program
+	uint64_t uniformsIssued;
+	uint64_t uniformsSkipped;
+	uint64_t uniformsMissing;	// Not an active uniform of the program, or set with the wrong size
+};
+
+enum shaderBuildState
+{
+	SHADER_IDLE,
+	SHADER_LINKING,		// Compile and link issued, polled every update until the driver is done
+};
+
+// Owns every shader program. Programs are loaded from .vert/.frag files, with #include "file" resolved
+// relative to the including file (each file is only included once) and the requested features defined
+// after the #version line. Features a stage never mentions are not defined for it, and variants that
+// expand to the same sources share one program, so only distinct permutations are ever compiled.
+// Every file a variant uses is watched, when one is saved the variant is rebuilt over the next few
+// frames and swapped in once it links. If the new version fails to compile the old program stays in use.
+// Compiles never block: every build is issued up front and polled each update, with
+// KHR_parallel_shader_compile the driver works through them on its own threads.
+// Linked programs are saved with glGetProgramBinary, keyed by a hash of the sources and the driver, and loaded
+// straight from that cache on the next start. Anything the driver rejects is compiled from source again.
 class ShaderManager
 {
 public:
-	bool initializeShaderManager();
+	ShaderManager();
+
+	// Without a state cache (tools) programs are bound directly when setting uniforms needs it
+	bool init(Logger* primaryLogger, FileManager* primaryFileManager, GLStateCache* primaryStateCache = nullptr);
+	void cleanup();
+
+	// Starts building the variant, it becomes usable once update sees the driver has finished. Asking for the
+	// same files and features again returns the same handle. A handle is returned even if the build fails,
+	// so fixing the files while running picks it up through the hot reload
+	ShaderHandle loadProgram(const char* vertexPath, const char* fragmentPath, ShaderFeatures features = 0);
+
+	// Same as loadProgram for a compute shader (GL 4.3), built, cached and reloaded like any other program
+	ShaderHandle loadComputeProgram(const char* computePath, ShaderFeatures features = 0);
+
+	// 0 until the program has linked successfully
+	GLuint getProgram(ShaderHandle handle) const;
+
+	// Picks up finished builds and rebuilds variants whose files changed, call once per frame outside of rendering
+	void update();
+
+	// True while any program passed to loadProgram is still compiling, for loading screens
+	bool isLoading() const { return pendingLoads > 0; }
+
+	// Blocks until every outstanding build has finished
+	void finishLoading();
+
+	ShaderStats getStats() const { return stats; }
+
+	// Typed uniform setters. Locations come from reflecting each program once after it links and the last
+	// value is remembered, so setting the same value again costs a hash lookup and no GL call.
+	// On 4.1+ they use glProgramUniform, on older contexts they bind the program with glUseProgram
+	void setUniform(ShaderHandle handle, uint64_t name, int value);
+	void setUniform(ShaderHandle handle, uint64_t name, float x);
+	void setUniform(ShaderHandle handle, uint64_t name, float x, float y);
+	void setUniform(ShaderHandle handle, uint64_t name, float x, float y, float z);
+	void setUniform(ShaderHandle handle, uint64_t name, float x, float y, float z, float w);
+	void setUniformMatrix4(ShaderHandle handle, uint64_t name, const float* matrix);
+
+	// Points a uniform block at a GL_UNIFORM_BUFFER binding point
+	void setUniformBlock(ShaderHandle handle, uint64_t name, GLuint bindingPoint);
+
+	// -1 if the program has no such uniform, for code that needs to make its own GL calls
+	GLint getUniformLocation(ShaderHandle handle, uint64_t name) const;
 
 private:
+	// Entry of a program's uniform table, open addressed by name hash. Blocks live in the same table
+	struct UniformSlot
+	{
+		uint64_t name = 0;		// 0 marks an empty slot
+		GLint location = -1;	// Block index for blocks
+		bool block = false;
+		bool hasValue = false;
+		uint32_t valueOffset = 0;
+		uint32_t valueSize = 0;
+	};
+
+	// One per distinct pair of preprocessed sources, shared by every variant that expands to it
+	struct ShaderProgram
+	{
+		std::string name;
+		uint64_t key = 0;	// Hash of both sources and the driver, also the binary cache key
+		uint32_t refCount = 0;
+		bool compute = false;
+
+		GLuint program = 0;
+
+		// Reflected once the program is linked, the table size is a power of two
+		std::vector<UniformSlot> uniforms;
+		std::vector<unsigned char> uniformValues;
+
+		// Build in progress
+		shaderBuildState state = SHADER_IDLE;
+		bool initialBuild = false;
+		std::string vertexSource;					// Compute programs only have this one
+		std::string fragmentSource;
+		std::vector<std::string> vertexFiles;		// By source number, for mapping compiler errors back to files
+		std::vector<std::string> fragmentFiles;
+		GLuint pendingVertex = 0;
+		GLuint pendingFragment = 0;
+		GLuint pendingProgram = 0;
+	};
+
+	struct ShaderVariant
+	{
+		std::string vertexPath;		// The compute shader of compute programs
+		std::string fragmentPath;	// Empty for compute programs
+		ShaderFeatures features = 0;
+
+		uint64_t programKey = 0;	// Program in use
+		uint64_t pendingKey = 0;	// Program being built by a reload
+		bool reloadRequested = false;
+
+		// Reload waiting for its sources, they are read in the background and pinned until the build is issued
+		bool reloading = false;
+		uint32_t sourcesPending = 0;
+		std::vector<std::string> readFiles;
+		std::vector<AssetHandle> sources;
+
+		std::vector<std::string> watchedFiles;	// Files this variant is listed under in fileVariants
+
+		std::string getName() const { return fragmentPath.empty() ? vertexPath : vertexPath + " + " + fragmentPath; }
+	};
+
+	// Systems
+	Logger* logger;
+	FileManager* fileManager;
+	GLStateCache* stateCache;
+
+	std::vector<ShaderVariant> variants;
+	std::unordered_map<std::string, ShaderHandle> variantLookup;
+
+	// Every watched file, with the variants that use it. Each file has one watch however many variants share it
+	std::unordered_map<std::string, std::vector<ShaderHandle>> fileVariants;
+	std::unordered_map<uint64_t, ShaderProgram> programs;
+	ShaderStats stats;
+
+	bool binaryCache;
+	uint64_t driverHash;
+
+	bool parallelCompile;
+	uint32_t pendingLoads;
+	bool loading;
+	std::chrono::steady_clock::time_point loadStart;
+
+	// Builds the sources of a variant and returns the key of the program they belong to, 0 if a file is missing.
+	// With missing the files are only taken from the asset cache, the ones that are not in it are added to missing
+	uint64_t buildVariant(ShaderHandle handle, bool initialBuild, std::vector<std::string>* missing = nullptr);
+	void readSources(ShaderHandle handle, const std::vector<std::string>& files);
+	void watchFiles(ShaderHandle handle, const std::vector<std::string>& files);
+	void releaseProgram(uint64_t key);
+
+	bool preprocess(const std::string& path, ShaderFeatures features, std::string& output, std::vector<std::string>& files, std::vector<std::string>* missing);
+	bool expandIncludes(const std::string& path, std::string& output, std::vector<std::string>& files, uint32_t depth, std::vector<std::string>* missing);
+
+	void beginBuild(ShaderProgram& shaderProgram);
+	bool finishBuild(ShaderProgram& shaderProgram);
+	bool isBuildComplete(const ShaderProgram& shaderProgram) const;
+	void completeBuild(ShaderProgram& shaderProgram);
+
+	void reflectProgram(ShaderProgram& shaderProgram);
+	void addUniform(ShaderProgram& shaderProgram, const char* name, GLint location, bool block, uint32_t valueSize);
+	const UniformSlot* findUniform(const ShaderProgram& shaderProgram, uint64_t name) const;
+	GLuint updateUniform(ShaderHandle handle, uint64_t name, const void* value, uint32_t size);
+
+	std::string binaryPath(uint64_t key) const;
+	bool loadBinary(ShaderProgram& shaderProgram);
+	void saveBinary(const ShaderProgram& shaderProgram);
+
+	GLuint compileShader(ShaderType type, const std::string& source);
+	GLuint compileProgram(GLuint vertexShader, GLuint fragmentShader);
+
+	bool validateShader(GLuint shader, const ShaderProgram& shaderProgram);
+	bool validateProgram(GLuint program, const ShaderProgram& shaderProgram);
 };
\ No newline at end of file
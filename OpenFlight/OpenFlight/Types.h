@@ -10,4 +10,5 @@ enum ShaderType
 {
 	VERTEX,
 	FRAGMENT,
+	COMPUTE,
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* UploadRing.cpp
+*/
+
+#include <chrono>
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+
+#include "UploadRing.h"
+#include "GLDebug.h"
+
+static bool hasBufferStorageExtension()
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp((const char*)extension, "GL_ARB_buffer_storage") == 0)
+			return true;
+	}
+
+	return false;
+}
+
+UploadRing::UploadRing()
+	: logger(nullptr), stateCache(nullptr), buffer(0), persistent(false), regionSize(0), mapped(nullptr), fences(), frame(0),
+	flushed(0), head(0), stats(), frameBytes(0), frameAllocations(0)
+{
+}
+
+bool UploadRing::init(Logger* primaryLogger, GLStateCache* primaryStateCache, size_t frameBytes)
+{
+	logger = primaryLogger;
+	stateCache = primaryStateCache;
+	regionSize = frameBytes;
+
+	// Core in 4.4, the extension uses the same name on older contexts
+	PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+	if (GLAD_GL_VERSION_4_4)
+		bufferStorage = glBufferStorage;
+	else if (hasBufferStorageExtension())
+		bufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+
+	glGenBuffers(1, &buffer);
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	if (bufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(regionSize * FRAMES), NULL, flags);
+		mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)(regionSize * FRAMES), flags);
+		persistent = mapped != nullptr;
+
+		// Storage is immutable, a failed mapping needs a new buffer for the fallback
+		if (!persistent)
+		{
+			OF_LOG(*logger, LOG_LVL_WRN, "Failed to map the upload ring persistently, falling back to orphaning");
+			stateCache->deleteBuffer(buffer);
+			glGenBuffers(1, &buffer);
+			stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		}
+	}
+
+	if (!persistent)
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)regionSize, NULL, GL_STREAM_DRAW);
+		staging.resize(regionSize);
+	}
+	glCheckError();
+
+	stats.persistent = persistent;
+	OF_LOG(*logger, LOG_LVL_INFO, "Upload ring of {} bytes per frame ({})", regionSize, persistent ? "persistent mapping" : "orphaning");
+
+	return true;
+}
+
+void UploadRing::cleanup()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	if (mapped)
+	{
+		stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		mapped = nullptr;
+	}
+
+	if (buffer)
+		stateCache->deleteBuffer(buffer);
+	buffer = 0;
+
+	staging.clear();
+}
+
+void UploadRing::beginFrame()
+{
+	head = 0;
+	flushed = 0;
+	frameBytes = 0;
+	frameAllocations = 0;
+
+	// The fallback has nothing to wait for, its storage is orphaned by the first flush
+	if (!persistent)
+		return;
+
+	GLsync& fence = fences[frame];
+	if (!fence)
+		return;
+
+	// Only a stall if the GPU is still FRAMES frames behind
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		do
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+
+		stats.stalls++;
+		stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	if (result == GL_WAIT_FAILED)
+		OF_LOG(*logger, LOG_LVL_ERR, "Waiting on an upload ring fence failed");
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void UploadRing::endFrame()
+{
+	flush();
+
+	if (persistent)
+	{
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frame = (frame + 1) % FRAMES;
+	}
+
+	stats.frameBytes = frameBytes;
+	stats.frameAllocations = frameAllocations;
+	stats.totalBytes += frameBytes;
+	if (frameBytes > stats.peakFrameBytes)
+		stats.peakFrameBytes = frameBytes;
+}
+
+void* UploadRing::allocate(size_t size, size_t alignment, GLintptr& offset)
+{
+	size_t start = alignment > 1 ? (head + alignment - 1) / alignment * alignment : head;
+	if (start > regionSize || size > regionSize - start)
+	{
+		stats.overflows++;
+		return nullptr;
+	}
+
+	head = start + size;
+	frameBytes += size;
+	frameAllocations++;
+
+	if (persistent)
+	{
+		offset = (GLintptr)(frame * regionSize + start);
+		return mapped + offset;
+	}
+
+	offset = (GLintptr)start;
+	return staging.data() + start;
+}
+
+void UploadRing::flush()
+{
+	// Coherent mappings are seen by the GPU without doing anything
+	if (persistent || flushed == head)
+		return;
+
+	stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	// Orphan the old storage on the frame's first upload, draws still reading it keep it alive and this frame
+	// writes into a new one
+	if (flushed == 0)
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)regionSize, NULL, GL_STREAM_DRAW);
+
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)flushed, (GLsizeiptr)(head - flushed), staging.data() + flushed);
+	glCheckError();
+
+	flushed = head;
+}
@@ -0,0 +1,85 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* UploadRing.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "Logger.h"
+
+struct UploadRingStats
+{
+	bool persistent;		// Mapped with ARB_buffer_storage, otherwise staged and uploaded into an orphaned buffer
+	uint64_t frameBytes;	// Last finished frame
+	uint32_t frameAllocations;
+	uint64_t peakFrameBytes;
+	uint64_t totalBytes;
+	uint32_t stalls;		// Frames that had to wait for the GPU to finish with their region
+	double stallMs;
+	uint32_t overflows;		// Allocations that did not fit in the frame's region
+};
+
+// Per frame data (instance transforms, HUD quads, particles...) written straight into GPU visible memory.
+// With ARB_buffer_storage the buffer is mapped once, persistent and coherent, and split into one region per
+// frame in flight. A fence after each frame tells when its region can be written again, so the CPU only waits
+// if it gets more than FRAMES frames ahead. Without it writes go to a staging copy that flush uploads into
+// a buffer orphaned by the first flush of each frame, which the driver renames instead of waiting. Frames that
+// allocate nothing cost nothing either way.
+class UploadRing
+{
+public:
+	UploadRing();
+
+	bool init(Logger* primaryLogger, GLStateCache* primaryStateCache, size_t frameBytes);
+	void cleanup();
+
+	// Waits until this frame's region is free, call before the first allocation of a frame
+	void beginFrame();
+
+	// Fences the frame's region, call after the last draw using it
+	void endFrame();
+
+	// Space for size bytes aligned to alignment, nullptr if the frame's region is full. The offset is into
+	// getBuffer() and is only valid for this frame
+	void* allocate(size_t size, size_t alignment, GLintptr& offset);
+
+	// Makes everything allocated so far visible to the GPU, call before drawing with it
+	void flush();
+
+	GLuint getBuffer() const { return buffer; }
+
+	UploadRingStats getStats() const { return stats; }
+
+	static const uint32_t FRAMES = 3;
+
+private:
+	// Systems
+	Logger* logger;
+	GLStateCache* stateCache;
+
+	GLuint buffer;
+	bool persistent;
+	size_t regionSize;
+
+	// Persistent mapping
+	char* mapped;
+	GLsync fences[FRAMES];
+	uint32_t frame;
+
+	// Orphaning fallback
+	std::vector<char> staging;
+	size_t flushed;
+
+	size_t head;
+	UploadRingStats stats;
+	uint64_t frameBytes;
+	uint32_t frameAllocations;
+};
\ No newline at end of file
@@ -1,7 +1,15 @@
-#version 420
+#version 330 core
+
+#ifdef INSTANCED
+in vec4 colour;
+#endif
 
 out vec4 frag_colour;
 
 void main() {
+#ifdef INSTANCED
+	frag_colour = colour;
+#else
 	frag_colour = vec4(0.5, 0.0, 0.5, 1.0);
+#endif
 }
\ No newline at end of file
@@ -1,7 +1,21 @@
-#version 420
+#version 330 core
 
-in vec3 vp;
+layout (location = 0) in vec3 vp;
+
+#ifdef INSTANCED
+layout (location = 4) in mat4 instanceTransform;
+layout (location = 8) in vec4 instanceColour;
+
+out vec4 colour;
+#endif
+
+uniform mat4 model;
 
 void main() {
-	gl_Position = vec4(vp, 1.0);
+#ifdef INSTANCED
+	colour = instanceColour;
+	gl_Position = model * instanceTransform * vec4(vp, 1.0);
+#else
+	gl_Position = model * vec4(vp, 1.0);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,215 @@
+/*
+* Copyright (c) 2022 - The OpenFlight Team
+*
+* ShaderCompiler.cpp
+*
+* Compiles every permutation of the given shader programs through the ShaderManager, so compile errors show up
+* at build time and the program binary cache in ShaderCache is already warm the first time the game starts.
+* Run it from the game directory on the machine (or driver) the cache is for, binaries only load on the driver
+* that produced them.
+* Usage: ShaderCompiler [-b] [<vertex shader> <fragment shader> | <compute shader>.comp ...]
+*   -b  only compile the base variant of each program, without any feature permutations
+* Without any programs it compiles the ones the game loads. Compute shaders are compiled as their base variant
+* only, and are skipped when the context is older than GL 4.3, the same as the game does.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "FileManager.h"
+#include "Logger.h"
+#include "ShaderManager.h"
+
+struct CompiledVariant
+{
+	const char* vertexPath;
+	const char* fragmentPath;	// Null for compute programs, vertexPath is the compute shader
+	ShaderFeatures features;
+	ShaderHandle handle;
+};
+
+// Keep in step with the programs the game loads
+static const char* const defaultPrograms[] = {
+	"vertexShader.vert", "fragmentShader.frag",
+	"cullInstances.comp",
+	"depthPyramid.comp",
+};
+
+static void printUsage()
+{
+	fprintf(stderr, "Usage: ShaderCompiler [-b] [<vertex shader> <fragment shader> | <compute shader>.comp ...]\n");
+}
+
+static bool isComputeShader(const char* path)
+{
+	size_t length = strlen(path);
+	return length >= 5 && strcmp(path + length - 5, ".comp") == 0;
+}
+
+int main(int argc, char** argv)
+{
+	bool baseOnly = false;
+
+	int arg = 1;
+	if (arg < argc && strcmp(argv[arg], "-b") == 0)
+	{
+		baseOnly = true;
+		arg++;
+	}
+
+	std::vector<const char*> programs(argv + arg, argv + argc);
+	if (programs.empty())
+		programs.assign(std::begin(defaultPrograms), std::end(defaultPrograms));
+
+	// Anything that is not a compute shader needs a fragment shader after it
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		if (isComputeShader(programs[i]))
+			continue;
+
+		if (i + 1 >= programs.size() || isComputeShader(programs[i + 1]))
+		{
+			printUsage();
+			return 1;
+		}
+		i++;
+	}
+
+	// Synchronous so compiler errors come out in order with the results below
+	LoggerSettings settings;
+	settings.async = false;
+
+	Logger logger;
+	if (!logger.initializeLogging(settings))
+	{
+		fprintf(stderr, "Failed to initialize logger\n");
+		return 1;
+	}
+
+	FileManager fileManager;
+	if (!fileManager.init(&logger))
+	{
+		fprintf(stderr, "Failed to initialize file manager\n");
+		logger.cleanup();
+		return 1;
+	}
+
+	// The same context the game asks for, from a window that is never shown
+	if (!glfwInit())
+	{
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		fileManager.cleanup();
+		logger.cleanup();
+		return 1;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(1, 1, "ShaderCompiler", NULL, NULL);
+	if (!window)
+	{
+		fprintf(stderr, "Failed to create an OpenGL context\n");
+		glfwTerminate();
+		fileManager.cleanup();
+		logger.cleanup();
+		return 1;
+	}
+
+	glfwMakeContextCurrent(window);
+
+	ShaderManager shaderManager;
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) || !shaderManager.init(&logger, &fileManager))
+	{
+		fprintf(stderr, "Failed to initialize OpenGL\n");
+		glfwTerminate();
+		fileManager.cleanup();
+		logger.cleanup();
+		return 1;
+	}
+
+	printf("Compiling for %s (%s)\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	// Every build is issued before waiting on any of them, so the driver can compile them in parallel
+	std::vector<CompiledVariant> compiled;
+	ShaderFeatures permutations = baseOnly ? 1 : 1 << SHADER_FEATURE_COUNT;
+	uint32_t skipped = 0;
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		if (isComputeShader(programs[i]))
+		{
+			if (!GLAD_GL_VERSION_4_3)
+			{
+				printf("%-6s %s (compute shaders need OpenGL 4.3)\n", "skip", programs[i]);
+				skipped++;
+				continue;
+			}
+
+			CompiledVariant variant;
+			variant.vertexPath = programs[i];
+			variant.fragmentPath = nullptr;
+			variant.features = 0;
+			variant.handle = shaderManager.loadComputeProgram(variant.vertexPath);
+			compiled.push_back(variant);
+			continue;
+		}
+
+		for (ShaderFeatures features = 0; features < permutations; features++)
+		{
+			CompiledVariant variant;
+			variant.vertexPath = programs[i];
+			variant.fragmentPath = programs[i + 1];
+			variant.features = features;
+			variant.handle = shaderManager.loadProgram(variant.vertexPath, variant.fragmentPath, features);
+			compiled.push_back(variant);
+		}
+		i++;
+	}
+
+	shaderManager.finishLoading();
+
+	uint32_t failed = 0;
+	for (const CompiledVariant& variant : compiled)
+	{
+		bool success = shaderManager.getProgram(variant.handle) != 0;
+		if (!success)
+			failed++;
+
+		if (variant.fragmentPath)
+			printf("%-6s %s + %s", success ? "ok" : "FAILED", variant.vertexPath, variant.fragmentPath);
+		else
+			printf("%-6s %s", success ? "ok" : "FAILED", variant.vertexPath);
+		for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			if (variant.features & (1 << i))
+				printf(" %s", shaderFeatureNames[i]);
+		}
+		printf("\n");
+	}
+
+	ShaderStats stats = shaderManager.getStats();
+	printf("%u variants, %u shared, %u compiled, %u already cached, %u failed, %u binaries written in %.1f ms\n",
+		stats.variants, stats.sharedPrograms, stats.compiledPrograms, stats.cachedPrograms, stats.failedPrograms,
+		stats.binariesWritten, stats.loadMs);
+
+	if (skipped > 0)
+		printf("Warning: %u compute programs were skipped, this driver does not run GPU culling\n", skipped);
+
+	if (stats.compiledPrograms > stats.binariesWritten)
+		printf("Warning: the driver did not hand out every program binary, the game will compile those on startup\n");
+
+	shaderManager.cleanup();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	fileManager.cleanup();
+	logger.cleanup();
+
+	return failed > 0 ? 1 : 0;
+}